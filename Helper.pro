@@ -27,22 +27,40 @@ HEADERS += \
     include/Helper/Platform/Cpu/emulated/math_emulated.h \
     include/Helper/Platform/Cpu/emulated/rounding_emulated.h \
     include/Helper/Platform/Cpu/cpu.h \
+    include/Helper/Platform/Cpu/dispatch.h \
+    include/Helper/Platform/Cpu/features.h \
     include/Helper/Platform/Cpu/intrinsics.h \
     include/Helper/Platform/Cpu/math.h \
     include/Helper/Platform/Cpu/rounding.h \
     include/Helper/Platform/Cpu/simd.h \
     include/Helper/Platform/Cpu/simd_condition.h \
     include/Helper/Platform/Cpu/simd_int.h \
+    include/Helper/Platform/Cpu/simd_reduction.h \
+    include/Helper/Platform/Cpu/topology.h \
     include/Helper/Platform/compiler.h \
     include/Helper/Platform/os.h \
+    include/Helper/Concurrency/MpmcQueue.h \
+    include/Helper/Concurrency/PerThreadCounter.h \
+    include/Helper/Concurrency/SeqLock.h \
+    include/Helper/Concurrency/SpinBarrier.h \
+    include/Helper/Concurrency/SpscRing.h \
+    include/Helper/CancellationToken.h \
+    include/Helper/Coroutine.h \
     include/Helper/FixedPoint.h \
-    include/Helper/ThreadPool.h
+    include/Helper/InlineFunction.h \
+    include/Helper/Pipeline.h \
+    include/Helper/ScratchArena.h \
+    include/Helper/TaskGraph.h \
+    include/Helper/ThreadPool.h \
+    include/Helper/TimerWheel.h \
+    include/Helper/Trace.h
 
 contains(QMAKE_HOST.arch, x86_64) | contains(QMAKE_HOST.arch, x86) {
     HEADERS += \
                include/Helper/Platform/Cpu/x86/math_x86.h \
                include/Helper/Platform/Cpu/x86/rounding_x86.h \
                include/Helper/Platform/Cpu/x86/avx/simd_avx.h \
+               include/Helper/Platform/Cpu/x86/avx/simd_double_avx.h \
                include/Helper/Platform/Cpu/x86/avx/simd_float_avx.h \
                include/Helper/Platform/Cpu/x86/avx/simd_int_avx.h \
                include/Helper/Platform/Cpu/x86/avx/simd_int8_avx.h \
@@ -55,6 +73,7 @@ contains(QMAKE_HOST.arch, x86_64) | contains(QMAKE_HOST.arch, x86) {
                include/Helper/Platform/Cpu/x86/avx/simd_uint32_avx.h \
                include/Helper/Platform/Cpu/x86/avx/simd_uint64_avx.h \
                include/Helper/Platform/Cpu/x86/sse/simd_sse.h \
+               include/Helper/Platform/Cpu/x86/sse/simd_double_sse.h \
                include/Helper/Platform/Cpu/x86/sse/simd_float_sse.h \
                include/Helper/Platform/Cpu/x86/sse/simd_int_sse.h \
                include/Helper/Platform/Cpu/x86/sse/simd_int8_sse.h \
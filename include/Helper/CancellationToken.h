@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace Helper
+{
+
+// cancellation flag shared by the copies of a token, the owner of the work cancels it and the work polls it,
+// an empty token is never cancelled and costs a null check
+class CancellationToken
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  inline CancellationToken() = default;
+
+  static inline CancellationToken create();
+  // the token gets cancelled when the deadline passes
+  static inline CancellationToken create(Clock::time_point deadline);
+  template<typename Rep, typename Period>
+  static inline CancellationToken createWithTimeout(std::chrono::duration<Rep, Period> timeout);
+
+  inline bool isValid() const;
+  inline bool hasDeadline() const;
+  inline Clock::time_point getDeadline() const;
+
+  // does nothing for an empty token
+  inline void cancel() const;
+  // a relaxed load, a token with a deadline also reads the clock until it is cancelled, so a hot loop may poll it
+  // every few iterations
+  inline bool isCancelled() const;
+
+private:
+  struct State
+  {
+    std::atomic<bool> m_cancelled{false};
+    bool m_hasDeadline = false;
+    Clock::time_point m_deadline;
+  };
+
+  std::shared_ptr<State> m_state;
+};
+
+// implementation
+
+inline CancellationToken CancellationToken::create()
+{
+  CancellationToken token;
+  token.m_state = std::make_shared<State>();
+  return token;
+}
+
+inline CancellationToken CancellationToken::create(Clock::time_point deadline)
+{
+  CancellationToken token = create();
+  token.m_state->m_hasDeadline = true;
+  token.m_state->m_deadline = deadline;
+  return token;
+}
+
+template<typename Rep, typename Period>
+inline CancellationToken CancellationToken::createWithTimeout(std::chrono::duration<Rep, Period> timeout)
+{
+  return create(Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+}
+
+inline bool CancellationToken::isValid() const
+{
+  return (bool)m_state;
+}
+
+inline bool CancellationToken::hasDeadline() const
+{
+  return m_state && m_state->m_hasDeadline;
+}
+
+inline CancellationToken::Clock::time_point CancellationToken::getDeadline() const
+{
+  return hasDeadline() ? m_state->m_deadline : Clock::time_point::max();
+}
+
+inline void CancellationToken::cancel() const
+{
+  if (m_state)
+    m_state->m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+inline bool CancellationToken::isCancelled() const
+{
+  if (!m_state)
+    return false;
+  if (m_state->m_cancelled.load(std::memory_order_relaxed))
+    return true;
+  if (!m_state->m_hasDeadline || Clock::now() < m_state->m_deadline)
+    return false;
+
+  // the later polls don't read the clock
+  m_state->m_cancelled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+}
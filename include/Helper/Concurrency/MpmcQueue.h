@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "../Platform/Cpu/cpu.h"
+
+namespace Helper
+{
+
+namespace Concurrency
+{
+
+// bounded lock-free queue for any number of producers and consumers, each cell has a sequence number telling whether
+// it is free or filled for the current lap, so a push or pop is a single CAS of the position, T should be default
+// constructible and move assignable, the values are kept in the cells until overwritten
+template<typename T>
+class MpmcQueue
+{
+public:
+  // capacity is rounded up to power of 2
+  inline explicit MpmcQueue(size_t capacity);
+
+  // returns false if the queue is full
+  inline bool push(const T& value);
+  inline bool push(T&& value);
+  // returns false if the queue is empty
+  inline bool pop(T& value);
+
+  inline size_t getCapacity() const;
+
+private:
+  MpmcQueue(const MpmcQueue& other) = delete;
+  MpmcQueue& operator=(const MpmcQueue& other) = delete;
+
+  struct Cell
+  {
+    std::atomic<size_t> m_sequence;
+    T m_value;
+  };
+
+  template<typename V>
+  inline bool pushValue(V&& value);
+
+  std::unique_ptr<Cell[]> m_cells;
+  size_t m_mask;
+  char m_padding0[Platform::Cpu::cacheLineSize];
+  std::atomic<size_t> m_pushPosition{0};
+  char m_padding1[Platform::Cpu::cacheLineSize];
+  std::atomic<size_t> m_popPosition{0};
+  char m_padding2[Platform::Cpu::cacheLineSize];
+};
+
+// implementation
+
+template<typename T>
+inline MpmcQueue<T>::MpmcQueue(size_t capacity)
+{
+  size_t size = 2;
+  for (; size < capacity;)
+    size *= 2;
+
+  m_cells.reset(new Cell[size]);
+  m_mask = size - 1;
+  for (size_t i = 0; i < size; i++)
+    m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::push(const T& value)
+{
+  return pushValue(value);
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::push(T&& value)
+{
+  return pushValue(std::move(value));
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::pop(T& value)
+{
+  size_t position = m_popPosition.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    Cell& cell = m_cells[position & m_mask];
+    intptr_t diff = (intptr_t)cell.m_sequence.load(std::memory_order_acquire) - (intptr_t)(position + 1);
+    if (diff == 0)
+    {
+      if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+      {
+        value = std::move(cell.m_value);
+        cell.m_sequence.store(position + m_mask + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+      return false; // empty
+    else
+      position = m_popPosition.load(std::memory_order_relaxed);
+  }
+}
+
+template<typename T>
+inline size_t MpmcQueue<T>::getCapacity() const
+{
+  return m_mask + 1;
+}
+
+template<typename T>
+template<typename V>
+inline bool MpmcQueue<T>::pushValue(V&& value)
+{
+  size_t position = m_pushPosition.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    Cell& cell = m_cells[position & m_mask];
+    intptr_t diff = (intptr_t)cell.m_sequence.load(std::memory_order_acquire) - (intptr_t)position;
+    if (diff == 0)
+    {
+      if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+      {
+        cell.m_value = std::forward<V>(value);
+        cell.m_sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+      return false; // full
+    else
+      position = m_pushPosition.load(std::memory_order_relaxed);
+  }
+}
+
+}
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "../Platform/Cpu/cpu.h"
+
+namespace Helper
+{
+
+namespace Concurrency
+{
+
+// counter split to slots of their own cache lines, the threads add to different slots, so the hot path doesn't move
+// a shared line between the cores, and the reader sums the slots, for statistics written much more often than read
+class PerThreadCounter
+{
+public:
+  // slotCount <= 0 selects a slot per logical cpu
+  inline explicit PerThreadCounter(int slotCount = 0);
+  inline ~PerThreadCounter();
+
+  // adds to the slot of the calling thread, the threads are given the slots round robin on their first use
+  inline void add(int64_t value = 1);
+  // adds to the given slot, e.g. the index of a pool thread, slot is taken modulo the slot count
+  inline void add(int slot, int64_t value);
+
+  // the sum of the slots, the additions running meanwhile may be counted or not
+  inline int64_t get() const;
+  inline void reset();
+
+  inline int getSlotCount() const;
+
+private:
+  PerThreadCounter(const PerThreadCounter& other) = delete;
+  PerThreadCounter& operator=(const PerThreadCounter& other) = delete;
+
+  struct Slot
+  {
+    std::atomic<int64_t> m_value{0};
+    char m_padding[Platform::Cpu::cacheLineSize - sizeof(std::atomic<int64_t>)];
+  };
+
+  static inline int currentThreadIndex();
+
+  // the slots are aligned to the cache line by hand, new doesn't align them before C++17
+  std::unique_ptr<char[]> m_memory;
+  Slot* m_slots;
+  int m_slotCount;
+};
+
+// implementation
+
+inline PerThreadCounter::PerThreadCounter(int slotCount) :
+  m_slotCount(slotCount > 0 ? slotCount : std::max((int)std::thread::hardware_concurrency(), 1))
+{
+  static_assert(sizeof(Slot) == Platform::Cpu::cacheLineSize, "a slot should fill a cache line");
+
+  m_memory.reset(new char[sizeof(Slot) * m_slotCount + Platform::Cpu::cacheLineSize]);
+  uintptr_t address = ((uintptr_t)m_memory.get() + Platform::Cpu::cacheLineSize - 1) & ~(uintptr_t)(Platform::Cpu::cacheLineSize - 1);
+  m_slots = (Slot*)address;
+  for (int i = 0; i < m_slotCount; i++)
+    new (&m_slots[i]) Slot();
+}
+
+inline PerThreadCounter::~PerThreadCounter()
+{
+  for (int i = 0; i < m_slotCount; i++)
+    m_slots[i].~Slot();
+}
+
+inline void PerThreadCounter::add(int64_t value)
+{
+  add(currentThreadIndex(), value);
+}
+
+inline void PerThreadCounter::add(int slot, int64_t value)
+{
+  // the slots may be shared by the threads if there are more threads than slots
+  m_slots[(unsigned)slot % (unsigned)m_slotCount].m_value.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline int64_t PerThreadCounter::get() const
+{
+  int64_t sum = 0;
+  for (int i = 0; i < m_slotCount; i++)
+    sum += m_slots[i].m_value.load(std::memory_order_relaxed);
+  return sum;
+}
+
+inline void PerThreadCounter::reset()
+{
+  for (int i = 0; i < m_slotCount; i++)
+    m_slots[i].m_value.store(0, std::memory_order_relaxed);
+}
+
+inline int PerThreadCounter::getSlotCount() const
+{
+  return m_slotCount;
+}
+
+inline int PerThreadCounter::currentThreadIndex()
+{
+  static std::atomic<int> nextIndex{0};
+  static thread_local int index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "../Platform/Cpu/intrinsics.h"
+
+namespace Helper
+{
+
+namespace Concurrency
+{
+
+// read-mostly value: a writer makes the sequence odd while it changes the value, a reader copies the value and retries
+// if the sequence was odd or has changed meanwhile, so the readers don't write any shared cache line and never block
+// the writer, the value is kept in atomic words, so a torn copy is a retry and not a data race
+template<typename T>
+class SeqLock
+{
+public:
+  inline SeqLock();
+  inline explicit SeqLock(const T& value);
+
+  inline T load() const;
+  // the writers are serialized by the sequence
+  inline void store(const T& value);
+
+private:
+  static_assert(std::is_trivially_copyable<T>::value, "the value is copied by words");
+
+  constexpr static size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  SeqLock(const SeqLock& other) = delete;
+  SeqLock& operator=(const SeqLock& other) = delete;
+
+  std::atomic<uint64_t> m_sequence{0};
+  std::atomic<uint64_t> m_words[wordCount];
+};
+
+// implementation
+
+template<typename T>
+inline SeqLock<T>::SeqLock() : SeqLock(T())
+{
+}
+
+template<typename T>
+inline SeqLock<T>::SeqLock(const T& value)
+{
+  uint64_t words[wordCount] = {};
+  memcpy(words, &value, sizeof(T));
+  for (size_t i = 0; i < wordCount; i++)
+    m_words[i].store(words[i], std::memory_order_relaxed);
+}
+
+template<typename T>
+inline T SeqLock<T>::load() const
+{
+  uint64_t words[wordCount];
+  for (;;)
+  {
+    uint64_t sequence = m_sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+    {
+      Platform::Cpu::pause();
+      continue;
+    }
+
+    for (size_t i = 0; i < wordCount; i++)
+      words[i] = m_words[i].load(std::memory_order_relaxed);
+
+    // the words are read before the sequence is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_sequence.load(std::memory_order_relaxed) == sequence)
+      break;
+  }
+
+  T value;
+  memcpy(&value, words, sizeof(T));
+  return value;
+}
+
+template<typename T>
+inline void SeqLock<T>::store(const T& value)
+{
+  uint64_t words[wordCount] = {};
+  memcpy(words, &value, sizeof(T));
+
+  uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    if (!(sequence & 1) && m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed))
+      break;
+
+    Platform::Cpu::pause();
+    sequence = m_sequence.load(std::memory_order_relaxed);
+  }
+
+  // the odd sequence is visible before any of the words
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < wordCount; i++)
+    m_words[i].store(words[i], std::memory_order_relaxed);
+  m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+#include "../Platform/Cpu/cpu.h"
+#include "../Platform/Cpu/intrinsics.h"
+
+namespace Helper
+{
+
+namespace Concurrency
+{
+
+// barrier for a fixed set of threads polling instead of sleeping, for short phases of threads running on their own
+// cpus, the last arriving thread flips the sense the others poll, so the barrier is reused without a reset
+class SpinBarrier
+{
+public:
+  inline explicit SpinBarrier(int threadCount);
+
+  // returns true for the last arriving thread, e.g. to do the serial part of the phase before the next wait()
+  inline bool wait();
+
+  inline int getThreadCount() const;
+
+private:
+  SpinBarrier(const SpinBarrier& other) = delete;
+  SpinBarrier& operator=(const SpinBarrier& other) = delete;
+
+  // iterations of pause() before the waiting thread starts yielding its cpu to the others
+  constexpr static int spinCount = 1 << 12;
+
+  int m_threadCount;
+  char m_padding0[Platform::Cpu::cacheLineSize];
+  std::atomic<int> m_remaining;
+  char m_padding1[Platform::Cpu::cacheLineSize];
+  std::atomic<bool> m_sense{false};
+  char m_padding2[Platform::Cpu::cacheLineSize];
+};
+
+// implementation
+
+inline SpinBarrier::SpinBarrier(int threadCount) : m_threadCount(threadCount), m_remaining(threadCount)
+{
+  assert(threadCount > 0);
+}
+
+inline bool SpinBarrier::wait()
+{
+  bool sense = m_sense.load(std::memory_order_relaxed);
+  if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    // the counter is reset before the waiting threads are released, so none of them arrives at the old count
+    m_remaining.store(m_threadCount, std::memory_order_relaxed);
+    m_sense.store(!sense, std::memory_order_release);
+    return true;
+  }
+
+  for (int i = 0; m_sense.load(std::memory_order_acquire) == sense; i++)
+  {
+    // lets other threads run on the cpu if it is oversubscribed
+    if (i < spinCount)
+      Platform::Cpu::pause();
+    else
+      std::this_thread::yield();
+  }
+  return false;
+}
+
+inline int SpinBarrier::getThreadCount() const
+{
+  return m_threadCount;
+}
+
+}
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "../Platform/Cpu/cpu.h"
+
+namespace Helper
+{
+
+namespace Concurrency
+{
+
+// bounded ring for a single producer and a single consumer thread, the positions are written by their owners only
+// and each side keeps a copy of the other one's position, so the shared cache lines are read only when the ring looks
+// full or empty, T should be default constructible and move assignable
+template<typename T>
+class SpscRing
+{
+public:
+  // capacity is rounded up to power of 2
+  inline explicit SpscRing(size_t capacity);
+
+  // producer thread only, returns false if the ring is full
+  inline bool push(const T& value);
+  inline bool push(T&& value);
+  // consumer thread only, returns false if the ring is empty
+  inline bool pop(T& value);
+
+  // exact for the producer and the consumer, a hint for the other threads
+  inline size_t getSize() const;
+  inline size_t getCapacity() const;
+
+private:
+  SpscRing(const SpscRing& other) = delete;
+  SpscRing& operator=(const SpscRing& other) = delete;
+
+  template<typename V>
+  inline bool pushValue(V&& value);
+
+  std::unique_ptr<T[]> m_values;
+  size_t m_mask;
+  char m_padding0[Platform::Cpu::cacheLineSize];
+  // producer data
+  std::atomic<size_t> m_pushPosition{0};
+  size_t m_cachedPopPosition = 0;
+  char m_padding1[Platform::Cpu::cacheLineSize];
+  // consumer data
+  std::atomic<size_t> m_popPosition{0};
+  size_t m_cachedPushPosition = 0;
+  char m_padding2[Platform::Cpu::cacheLineSize];
+};
+
+// implementation
+
+template<typename T>
+inline SpscRing<T>::SpscRing(size_t capacity)
+{
+  size_t size = 2;
+  for (; size < capacity;)
+    size *= 2;
+
+  m_values.reset(new T[size]);
+  m_mask = size - 1;
+}
+
+template<typename T>
+inline bool SpscRing<T>::push(const T& value)
+{
+  return pushValue(value);
+}
+
+template<typename T>
+inline bool SpscRing<T>::push(T&& value)
+{
+  return pushValue(std::move(value));
+}
+
+template<typename T>
+inline bool SpscRing<T>::pop(T& value)
+{
+  size_t position = m_popPosition.load(std::memory_order_relaxed);
+  if (position == m_cachedPushPosition)
+  {
+    m_cachedPushPosition = m_pushPosition.load(std::memory_order_acquire);
+    if (position == m_cachedPushPosition)
+      return false;
+  }
+
+  value = std::move(m_values[position & m_mask]);
+  m_popPosition.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T>
+inline size_t SpscRing<T>::getSize() const
+{
+  // the pop position is read first, so the difference is not negative, but it may pass the capacity
+  size_t popPosition = m_popPosition.load(std::memory_order_acquire);
+  size_t size = m_pushPosition.load(std::memory_order_acquire) - popPosition;
+  return size <= m_mask + 1 ? size : m_mask + 1;
+}
+
+template<typename T>
+inline size_t SpscRing<T>::getCapacity() const
+{
+  return m_mask + 1;
+}
+
+template<typename T>
+template<typename V>
+inline bool SpscRing<T>::pushValue(V&& value)
+{
+  size_t position = m_pushPosition.load(std::memory_order_relaxed);
+  if (position - m_cachedPopPosition > m_mask)
+  {
+    m_cachedPopPosition = m_popPosition.load(std::memory_order_acquire);
+    if (position - m_cachedPopPosition > m_mask)
+      return false;
+  }
+
+  m_values[position & m_mask] = std::forward<V>(value);
+  m_pushPosition.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+}
+
+}
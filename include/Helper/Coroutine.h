@@ -0,0 +1,369 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#ifdef HELPER_COROUTINES
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Helper
+{
+
+template<typename T = void> class Task;
+
+// lazily started coroutine returning T, it is started by co_await and resumes the awaiting coroutine when finished,
+// an exception of the coroutine is thrown by co_await
+template<typename T>
+class Task
+{
+public:
+  class promise_type;
+
+  inline Task() = default;
+  inline Task(Task&& other);
+  inline Task& operator=(Task&& other);
+  inline ~Task();
+
+  inline bool isValid() const;
+
+  inline bool await_ready() const;
+  inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter);
+  inline T await_resume();
+
+private:
+  template<typename> friend class WhenAll;
+
+  Task(const Task& other) = delete;
+  Task& operator=(const Task& other) = delete;
+
+  inline explicit Task(std::coroutine_handle<promise_type> coroutine);
+
+  std::coroutine_handle<promise_type> m_coroutine;
+};
+
+// resumes the awaiting coroutine when all the tasks are finished, the tasks are started as jobs of the pool,
+// so they run in parallel, the results are in the order of the tasks
+template<typename T>
+inline Task<std::vector<T>> whenAll(ThreadPool& threadPool, std::vector<Task<T>> tasks);
+inline Task<void> whenAll(ThreadPool& threadPool, std::vector<Task<void>> tasks);
+
+// runs the task in the pool and blocks the calling thread until it is finished, for the threads outside of the pool
+template<typename T>
+inline T syncWait(ThreadPool& threadPool, Task<T> task);
+
+// implementation
+
+// the state shared by the tasks of whenAll(), the last finished task resumes the awaiter
+struct TaskCounter
+{
+  std::atomic<int> m_pending;
+  std::coroutine_handle<> m_awaiter;
+};
+
+template<typename T>
+class TaskPromiseBase
+{
+public:
+  struct FinalAwaiter
+  {
+    inline bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    template<typename Promise>
+    inline std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+    {
+      TaskPromiseBase& promise = coroutine.promise();
+      if (promise.m_counter)
+      {
+        if (promise.m_counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+          return std::noop_coroutine();
+        return promise.m_counter->m_awaiter;
+      }
+      return promise.m_awaiter ? promise.m_awaiter : std::noop_coroutine();
+    }
+
+    inline void await_resume() const noexcept
+    {
+    }
+  };
+
+  inline std::suspend_always initial_suspend() noexcept
+  {
+    return {};
+  }
+
+  inline FinalAwaiter final_suspend() noexcept
+  {
+    return {};
+  }
+
+  inline void unhandled_exception()
+  {
+    m_exception = std::current_exception();
+  }
+
+  std::coroutine_handle<> m_awaiter;
+  TaskCounter* m_counter = nullptr;
+  std::exception_ptr m_exception;
+};
+
+template<typename T>
+class Task<T>::promise_type : public TaskPromiseBase<T>
+{
+public:
+  inline Task get_return_object()
+  {
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+  }
+
+  template<typename V>
+  inline void return_value(V&& value)
+  {
+    m_value.emplace(std::forward<V>(value));
+  }
+
+  inline T takeResult()
+  {
+    if (this->m_exception)
+      std::rethrow_exception(this->m_exception);
+    return std::move(*m_value);
+  }
+
+private:
+  std::optional<T> m_value;
+};
+
+template<>
+class Task<void>::promise_type : public TaskPromiseBase<void>
+{
+public:
+  inline Task get_return_object()
+  {
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+  }
+
+  inline void return_void()
+  {
+  }
+
+  inline void takeResult()
+  {
+    if (m_exception)
+      std::rethrow_exception(m_exception);
+  }
+};
+
+template<typename T>
+inline Task<T>::Task(std::coroutine_handle<promise_type> coroutine) : m_coroutine(coroutine)
+{
+}
+
+template<typename T>
+inline Task<T>::Task(Task&& other) : m_coroutine(std::exchange(other.m_coroutine, nullptr))
+{
+}
+
+template<typename T>
+inline Task<T>& Task<T>::operator=(Task&& other)
+{
+  if (this != &other)
+  {
+    if (m_coroutine)
+      m_coroutine.destroy();
+    m_coroutine = std::exchange(other.m_coroutine, nullptr);
+  }
+  return *this;
+}
+
+template<typename T>
+inline Task<T>::~Task()
+{
+  if (m_coroutine)
+    m_coroutine.destroy();
+}
+
+template<typename T>
+inline bool Task<T>::isValid() const
+{
+  return (bool)m_coroutine;
+}
+
+template<typename T>
+inline bool Task<T>::await_ready() const
+{
+  return false;
+}
+
+template<typename T>
+inline std::coroutine_handle<> Task<T>::await_suspend(std::coroutine_handle<> awaiter)
+{
+  // the task starts on the awaiting thread and resumes the awaiter on the thread it finishes on
+  assert(m_coroutine);
+  m_coroutine.promise().m_awaiter = awaiter;
+  return m_coroutine;
+}
+
+template<typename T>
+inline T Task<T>::await_resume()
+{
+  return m_coroutine.promise().takeResult();
+}
+
+// awaiter starting the tasks of whenAll()
+template<typename T>
+class WhenAll
+{
+public:
+  inline WhenAll(ThreadPool& threadPool, std::vector<Task<T>>& tasks) : m_threadPool(threadPool), m_tasks(tasks)
+  {
+  }
+
+  inline bool await_ready() const
+  {
+    return m_tasks.empty();
+  }
+
+  inline bool await_suspend(std::coroutine_handle<> awaiter)
+  {
+    // the counter holds an extra reference until all the tasks are started, so the awaiter is not resumed earlier
+    m_counter.m_pending.store((int)m_tasks.size() + 1, std::memory_order_relaxed);
+    m_counter.m_awaiter = awaiter;
+    for (Task<T>& task : m_tasks)
+    {
+      assert(task.m_coroutine);
+      task.m_coroutine.promise().m_counter = &m_counter;
+      std::coroutine_handle<> coroutine = task.m_coroutine;
+      m_threadPool.addJob([coroutine]() { coroutine.resume(); });
+    }
+    return m_counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1;
+  }
+
+  inline void await_resume() const
+  {
+  }
+
+  static inline T takeResult(Task<T>& task)
+  {
+    return task.m_coroutine.promise().takeResult();
+  }
+
+private:
+  ThreadPool& m_threadPool;
+  std::vector<Task<T>>& m_tasks;
+  TaskCounter m_counter;
+};
+
+template<typename T>
+inline Task<std::vector<T>> whenAll(ThreadPool& threadPool, std::vector<Task<T>> tasks)
+{
+  co_await WhenAll<T>(threadPool, tasks);
+
+  std::vector<T> results;
+  results.reserve(tasks.size());
+  for (Task<T>& task : tasks)
+    results.push_back(WhenAll<T>::takeResult(task));
+  co_return results;
+}
+
+inline Task<void> whenAll(ThreadPool& threadPool, std::vector<Task<void>> tasks)
+{
+  co_await WhenAll<void>(threadPool, tasks);
+
+  for (Task<void>& task : tasks)
+    WhenAll<void>::takeResult(task);
+}
+
+// coroutine of syncWait() started by resume() and destroying itself when finished
+struct SyncWaiter
+{
+  struct promise_type
+  {
+    inline SyncWaiter get_return_object()
+    {
+      return SyncWaiter{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    inline std::suspend_always initial_suspend() noexcept
+    {
+      return {};
+    }
+
+    inline std::suspend_never final_suspend() noexcept
+    {
+      return {};
+    }
+
+    inline void return_void()
+    {
+    }
+
+    inline void unhandled_exception()
+    {
+      std::terminate();
+    }
+  };
+
+  std::coroutine_handle<promise_type> m_coroutine;
+};
+
+template<typename T>
+struct SyncWaitState
+{
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_finished = false;
+  std::optional<typename std::conditional<std::is_void<T>::value, char, T>::type> m_result;
+  std::exception_ptr m_exception;
+};
+
+template<typename T>
+inline SyncWaiter syncWaitTask(ThreadPool& threadPool, Task<T>& task, SyncWaitState<T>& state)
+{
+  co_await threadPool.schedule();
+  try
+  {
+    if constexpr (std::is_void<T>::value)
+      co_await task;
+    else
+      state.m_result.emplace(co_await task);
+  }
+  catch (...)
+  {
+    state.m_exception = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> lock(state.m_mutex);
+  state.m_finished = true;
+  state.m_condition.notify_all();
+}
+
+template<typename T>
+inline T syncWait(ThreadPool& threadPool, Task<T> task)
+{
+  SyncWaitState<T> state;
+  syncWaitTask(threadPool, task, state).m_coroutine.resume();
+
+  std::unique_lock<std::mutex> lock(state.m_mutex);
+  for (; !state.m_finished;)
+    state.m_condition.wait(lock);
+  lock.unlock();
+
+  if (state.m_exception)
+    std::rethrow_exception(state.m_exception);
+  if constexpr (!std::is_void<T>::value)
+    return std::move(*state.m_result);
+}
+
+}
+
+#endif
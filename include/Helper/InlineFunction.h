@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Helper
+{
+
+template<typename Signature, size_t capacity = 6 * sizeof(void*)> class InlineFunction;
+
+// move-only callable wrapper which keeps the callable in the fixed size buffer inside the object and never allocates,
+// the callables larger than capacity are rejected at compile time
+template<typename R, typename... Args, size_t capacity>
+class InlineFunction<R(Args...), capacity>
+{
+public:
+  inline InlineFunction();
+  inline InlineFunction(std::nullptr_t);
+  template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+  inline InlineFunction(F&& f);
+  inline InlineFunction(InlineFunction&& other);
+  inline ~InlineFunction();
+
+  inline InlineFunction& operator=(InlineFunction&& other);
+  inline InlineFunction& operator=(std::nullptr_t);
+
+  inline explicit operator bool() const;
+  inline R operator()(Args... args);
+
+  template<typename F>
+  static constexpr bool fits();
+
+private:
+  InlineFunction(const InlineFunction& other) = delete;
+  InlineFunction& operator=(const InlineFunction& other) = delete;
+
+  struct Operations
+  {
+    R (*invoke)(void* f, Args&&... args);
+    // null for trivially copyable callables, they are moved with memcpy() and not destroyed
+    void (*move)(void* dst, void* src);
+    void (*destroy)(void* f);
+    size_t size; // bytes to copy, empty callables have none
+  };
+
+  template<typename F>
+  static inline const Operations* operations();
+
+  inline void moveFrom(InlineFunction& other);
+  inline void reset();
+
+  alignas(std::max_align_t) unsigned char m_storage[capacity];
+  const Operations* m_operations;
+};
+
+// implementation
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>::InlineFunction() : m_operations(nullptr)
+{
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>::InlineFunction(std::nullptr_t) : m_operations(nullptr)
+{
+}
+
+template<typename R, typename... Args, size_t capacity> template<typename F, typename>
+inline InlineFunction<R(Args...), capacity>::InlineFunction(F&& f)
+{
+  typedef typename std::decay<F>::type Function;
+  static_assert(fits<Function>(), "callable does not fit into InlineFunction, capture less or capture by pointer");
+
+  new (m_storage) Function(std::forward<F>(f));
+  m_operations = operations<Function>();
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>::InlineFunction(InlineFunction&& other) : m_operations(nullptr)
+{
+  moveFrom(other);
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>::~InlineFunction()
+{
+  reset();
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>& InlineFunction<R(Args...), capacity>::operator=(InlineFunction&& other)
+{
+  if (this != &other)
+  {
+    reset();
+    moveFrom(other);
+  }
+  return *this;
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>& InlineFunction<R(Args...), capacity>::operator=(std::nullptr_t)
+{
+  reset();
+  return *this;
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline InlineFunction<R(Args...), capacity>::operator bool() const
+{
+  return m_operations != nullptr;
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline R InlineFunction<R(Args...), capacity>::operator()(Args... args)
+{
+  return m_operations->invoke(m_storage, std::forward<Args>(args)...);
+}
+
+template<typename R, typename... Args, size_t capacity> template<typename F>
+inline constexpr bool InlineFunction<R(Args...), capacity>::fits()
+{
+  return sizeof(F) <= capacity && alignof(F) <= alignof(std::max_align_t);
+}
+
+template<typename R, typename... Args, size_t capacity> template<typename F>
+inline const typename InlineFunction<R(Args...), capacity>::Operations* InlineFunction<R(Args...), capacity>::operations()
+{
+  struct Implementation
+  {
+    static R invoke(void* f, Args&&... args)
+    {
+      return (*(F*)f)(std::forward<Args>(args)...);
+    }
+
+    static void move(void* dst, void* src)
+    {
+      new (dst) F(std::move(*(F*)src));
+      ((F*)src)->~F();
+    }
+
+    static void destroy(void* f)
+    {
+      ((F*)f)->~F();
+    }
+  };
+
+  constexpr bool trivial = std::is_trivially_copyable<F>::value;
+  static const Operations operations = {&Implementation::invoke, trivial ? nullptr : &Implementation::move,
+    trivial ? nullptr : &Implementation::destroy, std::is_empty<F>::value ? 0 : sizeof(F)};
+  return &operations;
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline void InlineFunction<R(Args...), capacity>::moveFrom(InlineFunction& other)
+{
+  if (!other.m_operations)
+    return;
+
+  if (other.m_operations->move)
+    other.m_operations->move(m_storage, other.m_storage);
+  else
+    memcpy(m_storage, other.m_storage, other.m_operations->size);
+
+  m_operations = other.m_operations;
+  other.m_operations = nullptr;
+}
+
+template<typename R, typename... Args, size_t capacity>
+inline void InlineFunction<R(Args...), capacity>::reset()
+{
+  if (m_operations && m_operations->destroy)
+    m_operations->destroy(m_storage);
+  m_operations = nullptr;
+}
+
+}
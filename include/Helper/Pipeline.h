@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Concurrency/MpmcQueue.h"
+#include "ThreadPool.h"
+
+namespace Helper
+{
+
+// stream of tokens produced by the source and passed through a sequence of stages in the ThreadPool, the stages of
+// different tokens overlap, the number of tokens in flight is limited, so the data of a stream step stays in the cache
+// and a slow stage stops the source instead of piling up the buffers
+template<typename Token>
+class Pipeline
+{
+public:
+  enum class StageMode
+  {
+    Serial,   // one token at a time in the order the source produced them
+    Parallel, // any number of tokens at a time, in any order
+  };
+
+  // tokenLimit <= 0 selects 2 tokens per pool thread
+  inline Pipeline(ThreadPool& threadPool, int tokenLimit = 0);
+
+  // source(token) fills the next token and returns false at the end of the stream, it is run serially, the token
+  // objects are reused, so the buffers they own are allocated only once
+  inline void setSource(const std::function<bool(Token&)>& source);
+  inline void addStage(StageMode mode, const std::function<void(Token&)>& f);
+
+  inline int getTokenLimit() const;
+
+  // runs the stream to the end and waits for it, the waiting thread runs queued pool jobs meanwhile
+  inline void run();
+
+private:
+  Pipeline(const Pipeline& other) = delete;
+  Pipeline& operator=(const Pipeline& other) = delete;
+
+  struct Stage
+  {
+    StageMode m_mode;
+    std::function<void(Token&)> m_function;
+    // serial stage: the tokens waiting for the stage at (sequence number % token limit), -1 for no token
+    std::unique_ptr<std::atomic<int>[]> m_tokens;
+    std::atomic<bool> m_busy{false};
+    // sequence number of the next token to process, owned by the thread which set m_busy
+    uint64_t m_next = 0;
+  };
+
+  inline void produce();
+  inline void process(int token, size_t stage);
+  inline int processSerial(int token, size_t stage);
+
+  ThreadPool::TaskGroup m_group;
+  int m_tokenLimit;
+  std::vector<Token> m_tokens;
+  std::vector<uint64_t> m_sequences;
+  std::deque<Stage> m_stages;
+
+  std::function<bool(Token&)> m_source;
+  Concurrency::MpmcQueue<int> m_freeTokens;
+  std::atomic<int> m_freeTokenCount;
+  std::atomic<bool> m_sourceBusy{false};
+  std::atomic<bool> m_sourceEnded{false};
+  uint64_t m_nextSequence = 0;
+};
+
+// implementation
+
+template<typename Token>
+inline Pipeline<Token>::Pipeline(ThreadPool& threadPool, int tokenLimit) : m_group(threadPool),
+  m_tokenLimit(tokenLimit > 0 ? tokenLimit : 2 * std::max(threadPool.getThreadCount(), 1)), m_tokens(m_tokenLimit),
+  m_sequences(m_tokenLimit), m_freeTokens(m_tokenLimit), m_freeTokenCount(m_tokenLimit)
+{
+  for (int i = 0; i < m_tokenLimit; i++)
+    m_freeTokens.push(i);
+}
+
+template<typename Token>
+inline void Pipeline<Token>::setSource(const std::function<bool(Token&)>& source)
+{
+  m_source = source;
+}
+
+template<typename Token>
+inline void Pipeline<Token>::addStage(StageMode mode, const std::function<void(Token&)>& f)
+{
+  m_stages.emplace_back();
+  Stage& stage = m_stages.back();
+  stage.m_mode = mode;
+  stage.m_function = f;
+  if (mode == StageMode::Serial)
+  {
+    stage.m_tokens.reset(new std::atomic<int>[m_tokenLimit]);
+    for (int i = 0; i < m_tokenLimit; i++)
+      stage.m_tokens[i].store(-1, std::memory_order_relaxed);
+  }
+}
+
+template<typename Token>
+inline int Pipeline<Token>::getTokenLimit() const
+{
+  return m_tokenLimit;
+}
+
+template<typename Token>
+inline void Pipeline<Token>::run()
+{
+  assert(m_source);
+
+  m_sourceEnded.store(false, std::memory_order_relaxed);
+  m_nextSequence = 0;
+  for (Stage& stage : m_stages)
+    stage.m_next = 0;
+
+  m_group.run([this]() { produce(); });
+  m_group.wait();
+}
+
+template<typename Token>
+inline void Pipeline<Token>::produce()
+{
+  for (;;)
+  {
+    // a single thread runs the source, the others leave the tokens they free to it
+    bool busy = false;
+    if (!m_sourceBusy.compare_exchange_strong(busy, true))
+      return;
+
+    int token;
+    for (; !m_sourceEnded.load(std::memory_order_relaxed) && m_freeTokens.pop(token);)
+    {
+      m_freeTokenCount.fetch_sub(1);
+      if (!m_source(m_tokens[token]))
+      {
+        m_sourceEnded.store(true, std::memory_order_relaxed);
+        m_freeTokens.push(token);
+        m_freeTokenCount.fetch_add(1);
+        break;
+      }
+
+      m_sequences[token] = m_nextSequence++;
+      m_group.run([this, token]() { process(token, 0); });
+    }
+
+    m_sourceBusy.store(false);
+    // a token freed after the last pop found the source busy
+    if (m_sourceEnded.load(std::memory_order_relaxed) || m_freeTokenCount.load() == 0)
+      return;
+  }
+}
+
+template<typename Token>
+inline void Pipeline<Token>::process(int token, size_t stage)
+{
+  for (; stage < m_stages.size(); stage++)
+  {
+    if (m_stages[stage].m_mode == StageMode::Parallel)
+      m_stages[stage].m_function(m_tokens[token]);
+    else
+    {
+      token = processSerial(token, stage);
+      if (token < 0)
+        return;
+    }
+  }
+
+  m_freeTokens.push(token);
+  m_freeTokenCount.fetch_add(1);
+  produce();
+}
+
+template<typename Token>
+inline int Pipeline<Token>::processSerial(int token, size_t stageIndex)
+{
+  // the token is put to its place in the order, the thread which owns the stage processes the tokens while the next one
+  // is there, passes all of them but the last one to the next stage by pool jobs and carries the last one itself
+  Stage& stage = m_stages[stageIndex];
+  stage.m_tokens[m_sequences[token] % m_tokenLimit].store(token);
+
+  int last = -1;
+  for (;;)
+  {
+    bool busy = false;
+    if (!stage.m_busy.compare_exchange_strong(busy, true))
+      break;
+
+    uint64_t next = stage.m_next;
+    for (;;)
+    {
+      std::atomic<int>& slot = stage.m_tokens[next % m_tokenLimit];
+      int ready = slot.load(std::memory_order_acquire);
+      if (ready < 0)
+        break;
+
+      slot.store(-1, std::memory_order_relaxed);
+      next++;
+      stage.m_function(m_tokens[ready]);
+
+      if (last >= 0)
+        m_group.run([this, last, stageIndex]() { process(last, stageIndex + 1); });
+      last = ready;
+    }
+
+    stage.m_next = next;
+    stage.m_busy.store(false);
+    // a token stored after the last check found the stage busy
+    if (stage.m_tokens[next % m_tokenLimit].load() < 0)
+      break;
+  }
+
+  return last;
+}
+
+}
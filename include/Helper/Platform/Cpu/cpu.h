@@ -93,6 +93,9 @@ constexpr ByteOrder byteOrder = LittleEndian;
 
 constexpr int wordBits = (family == Family::x86_64 || family == Family::Arm64 || family == Family::Mips64) ? 64 : 32;
 
+// destructive interference size used for padding of the data shared between threads
+constexpr int cacheLineSize = (family == Family::Arm64) ? 128 : 64;
+
 namespace Feature
 {
 #if defined(PLATFORM_CPU_X86)
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "../compiler.h"
+#include "cpu.h"
+#include "features.h"
+
+#ifdef PLATFORM_CPU_X86
+#  include <immintrin.h>
+#endif
+
+// attributes of a function compiled for an instruction set above the baseline of the build, so a binary built for
+// the baseline has the kernels for the newer cpus too, the function may be called only if getSimdLevel() reports
+// the set, MSVC compiles the intrinsics of any set without them, a dispatched kernel is a static function of raw
+// intrinsics with these attributes, not a translation unit built with e.g. -mavx2 using SIMD<>, as the linker keeps
+// one copy of every inline function of the headers, the SIMD<> members and the std templates among them, and may
+// pick the avx2 one for the baseline callers
+#if defined(PLATFORM_CPU_X86) && defined(PLATFORM_COMPILER_GNU)
+#  define PLATFORM_CPU_TARGET_SSE41 __attribute__((target("sse4.1")))
+#  define PLATFORM_CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#  define PLATFORM_CPU_TARGET_SSE41
+#  define PLATFORM_CPU_TARGET_AVX2
+#endif
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+enum class SimdLevel
+{
+  Scalar,
+  SSE41,
+  AVX2, // with FMA
+};
+
+// best instruction set of the running cpu by CpuFeatures, simd.h is not included, as it is built for the instruction
+// sets of the build
+inline SimdLevel getSimdLevel();
+
+// implementation of a kernel chosen once for the running cpu, the call costs an indirect call, e.g.
+//   static const Dispatch<float(*)(const float*, int)> sum(sumScalar, sumSSE41, sumAVX2);
+//   float s = sum(data, size);
+// a null implementation is skipped, the scalar one is required
+template<typename Function>
+class Dispatch
+{
+public:
+  inline explicit Dispatch(Function scalar, Function sse41 = nullptr, Function avx2 = nullptr);
+
+  inline Function get() const;
+  inline SimdLevel getLevel() const;
+
+  template<typename ...Args>
+  inline auto operator()(Args&&... args) const -> decltype(std::declval<Function>()(std::forward<Args>(args)...));
+
+private:
+  Function m_function;
+  SimdLevel m_level;
+};
+
+// sum of the floats by the best kernel of the running cpu, the order of the additions and so the rounding of the
+// result depend on the kernel
+static inline float dispatchedReductionSum(const float* data, size_t count);
+
+// implementation
+
+inline SimdLevel getSimdLevel()
+{
+  static const SimdLevel level = []()
+  {
+    const CpuFeatures& features = CpuFeatures::get();
+    if (features.avx2 && features.fma)
+      return SimdLevel::AVX2;
+    if (features.sse41)
+      return SimdLevel::SSE41;
+    return SimdLevel::Scalar;
+  }();
+
+  return level;
+}
+
+// Dispatch<Function>
+
+template<typename Function>
+inline Dispatch<Function>::Dispatch(Function scalar, Function sse41, Function avx2) : m_function(scalar),
+  m_level(SimdLevel::Scalar)
+{
+  SimdLevel level = getSimdLevel();
+  if (avx2 && level >= SimdLevel::AVX2)
+  {
+    m_function = avx2;
+    m_level = SimdLevel::AVX2;
+  }
+  else if (sse41 && level >= SimdLevel::SSE41)
+  {
+    m_function = sse41;
+    m_level = SimdLevel::SSE41;
+  }
+}
+
+template<typename Function>
+inline Function Dispatch<Function>::get() const
+{
+  return m_function;
+}
+
+template<typename Function>
+inline SimdLevel Dispatch<Function>::getLevel() const
+{
+  return m_level;
+}
+
+template<typename Function>
+template<typename ...Args>
+inline auto Dispatch<Function>::operator()(Args&&... args) const -> decltype(std::declval<Function>()(std::forward<Args>(args)...))
+{
+  return m_function(std::forward<Args>(args)...);
+}
+
+// dispatchedReductionSum
+
+static inline float reductionSumScalar(const float* data, size_t count)
+{
+  float result = 0;
+  for (size_t i = 0; i < count; i++)
+    result += data[i];
+  return result;
+}
+
+#ifdef PLATFORM_CPU_X86
+
+PLATFORM_CPU_TARGET_SSE41 static inline float reductionSumSSE41(const float* data, size_t count)
+{
+  // two accumulators hide the latency of the addition
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  for (; count >= 8; data += 8, count -= 8)
+  {
+    sum0 = _mm_add_ps(sum0, _mm_loadu_ps(data));
+    sum1 = _mm_add_ps(sum1, _mm_loadu_ps(data + 4));
+  }
+  if (count >= 4)
+  {
+    sum0 = _mm_add_ps(sum0, _mm_loadu_ps(data));
+    data += 4;
+    count -= 4;
+  }
+
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum) + reductionSumScalar(data, count);
+}
+
+PLATFORM_CPU_TARGET_AVX2 static inline float reductionSumAVX2(const float* data, size_t count)
+{
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  for (; count >= 16; data += 16, count -= 16)
+  {
+    sum0 = _mm256_add_ps(sum0, _mm256_loadu_ps(data));
+    sum1 = _mm256_add_ps(sum1, _mm256_loadu_ps(data + 8));
+  }
+  if (count >= 8)
+  {
+    sum0 = _mm256_add_ps(sum0, _mm256_loadu_ps(data));
+    data += 8;
+    count -= 8;
+  }
+
+  __m256 sum256 = _mm256_add_ps(sum0, sum1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum) + reductionSumScalar(data, count);
+}
+
+#endif
+
+static inline float dispatchedReductionSum(const float* data, size_t count)
+{
+#ifdef PLATFORM_CPU_X86
+  static const Dispatch<float(*)(const float*, size_t)> sum(reductionSumScalar, reductionSumSSE41, reductionSumAVX2);
+#else
+  static const Dispatch<float(*)(const float*, size_t)> sum(reductionSumScalar);
+#endif
+  return sum(data, count);
+}
+
+}
+
+}
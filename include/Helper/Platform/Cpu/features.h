@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cpu.h"
+
+#ifdef PLATFORM_CPU_X86
+#  include "x86/x86.h"
+#endif
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+// instruction sets of the running cpu decoded from cpuid once, the sets using the AVX and AVX-512 registers are
+// reported only if the OS saves their state (XCR0), otherwise their instructions fault, all false on the other cpus
+struct CpuFeatures
+{
+  // leaf 1
+  bool sse = false;
+  bool sse2 = false;
+  bool sse3 = false;
+  bool ssse3 = false;
+  bool sse41 = false;
+  bool sse42 = false;
+  bool popcnt = false;
+  bool aes = false;
+  bool clmul = false;
+  bool avx = false;
+  bool fma = false;
+  bool f16c = false;
+  // leaf 7
+  bool avx2 = false;
+  bool bmi1 = false;
+  bool bmi2 = false;
+  bool sha = false;
+  bool avx512f = false;
+  bool avx512dq = false;
+  bool avx512cd = false;
+  bool avx512bw = false;
+  bool avx512vl = false;
+  bool avx512ifma = false;
+  bool avx512vbmi = false;
+  bool avx512vbmi2 = false;
+  bool avx512vnni = false;
+  bool avx512bitalg = false;
+  bool avx512vpopcntdq = false;
+  bool avx512bf16 = false;
+  bool avxvnni = false;
+  // leaf 0x80000001
+  bool lzcnt = false;
+  bool prefetchw = false;
+  // OS support by xgetbv
+  bool osxsave = false;
+  bool osYmmState = false;
+  bool osZmmState = false;
+  // leaf 0xD, bytes of the XSAVE area for the state enabled by the OS, 0 without XSAVE
+  uint32_t xsaveSize = 0;
+
+  // the first call detects the features, the later ones read them
+  static inline const CpuFeatures& get();
+
+private:
+  static inline CpuFeatures detect();
+};
+
+// implementation
+
+inline const CpuFeatures& CpuFeatures::get()
+{
+  static const CpuFeatures features = detect();
+  return features;
+}
+
+inline CpuFeatures CpuFeatures::detect()
+{
+  CpuFeatures f;
+
+#ifdef PLATFORM_CPU_X86
+  uint32_t maxLeaf = x86cpuid(0, 0, 0);
+  uint32_t maxExtendedLeaf = x86cpuid(0x80000000, 0, 0);
+
+  uint32_t ecx1 = maxLeaf >= 1 ? x86cpuid(1, 0, 2) : 0;
+  uint32_t edx1 = maxLeaf >= 1 ? x86cpuid(1, 0, 3) : 0;
+  uint32_t ebx7 = maxLeaf >= 7 ? x86cpuid(7, 0, 1) : 0;
+  uint32_t ecx7 = maxLeaf >= 7 ? x86cpuid(7, 0, 2) : 0;
+  uint32_t maxLeaf7 = maxLeaf >= 7 ? x86cpuid(7, 0, 0) : 0;
+  uint32_t eax71 = maxLeaf7 >= 1 ? x86cpuid(7, 1, 0) : 0;
+  uint32_t ecx81 = maxExtendedLeaf >= 0x80000001 ? x86cpuid(0x80000001, 0, 2) : 0;
+
+  f.osxsave = ecx1 & (1 << 27);
+  uint64_t xcr0 = f.osxsave ? x86xgetbv(0) : 0;
+  // SSE and AVX state, and the opmask and ZMM states of AVX-512 on top
+  f.osYmmState = (xcr0 & 0x6) == 0x6;
+  f.osZmmState = f.osYmmState && (xcr0 & 0xe0) == 0xe0;
+  if (f.osxsave && maxLeaf >= 0xd)
+    f.xsaveSize = x86cpuid(0xd, 0, 1);
+
+  f.sse = edx1 & (1 << 25);
+  f.sse2 = edx1 & (1 << 26);
+  f.sse3 = ecx1 & (1 << 0);
+  f.clmul = ecx1 & (1 << 1);
+  f.ssse3 = ecx1 & (1 << 9);
+  f.sse41 = ecx1 & (1 << 19);
+  f.sse42 = ecx1 & (1 << 20);
+  f.popcnt = ecx1 & (1 << 23);
+  f.aes = ecx1 & (1 << 25);
+  f.avx = f.osYmmState && (ecx1 & (1 << 28));
+  f.fma = f.avx && (ecx1 & (1 << 12));
+  f.f16c = f.avx && (ecx1 & (1 << 29));
+
+  f.bmi1 = ebx7 & (1 << 3);
+  f.avx2 = f.avx && (ebx7 & (1 << 5));
+  f.bmi2 = ebx7 & (1 << 8);
+  f.sha = ebx7 & (1 << 29);
+  f.avxvnni = f.avx && (eax71 & (1 << 4));
+
+  if (f.osZmmState && (ebx7 & (1 << 16)))
+  {
+    f.avx512f = true;
+    f.avx512dq = ebx7 & (1 << 17);
+    f.avx512ifma = ebx7 & (1 << 21);
+    f.avx512cd = ebx7 & (1 << 28);
+    f.avx512bw = ebx7 & (1u << 30);
+    f.avx512vl = ebx7 & (1u << 31);
+    f.avx512vbmi = ecx7 & (1 << 1);
+    f.avx512vbmi2 = ecx7 & (1 << 6);
+    f.avx512vnni = ecx7 & (1 << 11);
+    f.avx512bitalg = ecx7 & (1 << 12);
+    f.avx512vpopcntdq = ecx7 & (1 << 14);
+    f.avx512bf16 = eax71 & (1 << 5);
+  }
+
+  f.lzcnt = ecx81 & (1 << 5);
+  f.prefetchw = ecx81 & (1 << 8);
+#endif
+
+  return f;
+}
+
+}
+
+}
@@ -8,6 +8,7 @@
 #include <cstdint>
 
 #include "cpu.h"
+#include "features.h"
 
 #if !defined(PLATFORM_COMPILER_MSVC) && !defined(PLATFORM_COMPILER_GNU)
 #include <cassert>
@@ -15,6 +16,12 @@
 
 #ifdef PLATFORM_CPU_X86
 #  include "x86/x86.h"
+#  include <immintrin.h>
+#  ifdef PLATFORM_COMPILER_GNU
+#    include <x86intrin.h>
+#  endif
+#else
+#  include <chrono>
 #endif
 
 namespace Platform
@@ -27,6 +34,10 @@ template <typename T> inline bool havePopcntInstruction();
 template <typename T> inline int popcnt(T word);
 template <typename T> inline int leastSignificantSetBit(T word);
 template <typename T> inline int mostSignificantSetBit(T word);
+// spin-wait loop hint, lets the other hardware thread of the core run and saves power while polling
+inline void pause();
+// cheap monotonic tick counter for measuring short intervals, the tick length is not specified
+inline uint64_t readTimestampCounter();
 
 // implementation
 
@@ -37,7 +48,7 @@ template <typename T> inline bool havePopcntInstruction()
   if (sizeof(T) == 8)
     return false;
 #endif
-  return getx86CpuFeaturesWord(2) & (1 << 23);
+  return CpuFeatures::get().popcnt;
 #else
   return false;
 #endif
@@ -149,6 +160,26 @@ template<typename T> inline int mostSignificantSetBit(T word)
 #endif
 }
 
+inline void pause()
+{
+#if defined(PLATFORM_CPU_X86)
+  _mm_pause();
+#elif defined(PLATFORM_CPU_ARM) && defined(PLATFORM_COMPILER_GNU)
+  asm volatile("yield");
+#elif defined(PLATFORM_CPU_ARM) && defined(PLATFORM_COMPILER_MSVC)
+  __yield();
+#endif
+}
+
+inline uint64_t readTimestampCounter()
+{
+#if defined(PLATFORM_CPU_X86)
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <type_traits>
 
@@ -961,6 +962,8 @@ namespace Cpu
 
 typedef typename SIMD<float, 4>::Type floatx4_t;
 typedef typename SIMD<float, 8>::Type floatx8_t;
+typedef typename SIMD<double, 2>::Type doublex2_t;
+typedef typename SIMD<double, 4>::Type doublex4_t;
 
 typedef typename SIMD<int8_t, 16>::Type int8x16_t;
 typedef typename SIMD<int16_t, 8>::Type int16x8_t;
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+#include "simd.h"
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+// reductions of arrays by SIMD<T, width> vectors, also suitable as ThreadPool::parallelReduce() kernels for the parts
+// of an array, the unaligned head and the tail of the array are processed by scalars
+template<typename T, int width> static inline T reductionSum(const T* data, size_t count);
+// count should be > 0
+template<typename T, int width> static inline T reductionMin(const T* data, size_t count);
+template<typename T, int width> static inline T reductionMax(const T* data, size_t count);
+
+// implementation
+
+template<typename T, int width>
+static inline T reductionSum(const T* data, size_t count)
+{
+  typedef SIMD<T, width> Simd;
+
+  T result = 0;
+  for (; count > 0 && !Simd::isPointerAligned(data); data++, count--)
+    result += *data;
+
+  if (count >= (size_t)width)
+  {
+    // two accumulators hide the latency of the addition
+    typename Simd::Type sum0 = Simd::zero(), sum1 = Simd::zero();
+    for (; count >= 2 * (size_t)width; data += 2 * width, count -= 2 * width)
+    {
+      sum0 = sum0 + Simd::load(data);
+      sum1 = sum1 + Simd::load(data + width);
+    }
+    if (count >= (size_t)width)
+    {
+      sum0 = sum0 + Simd::load(data);
+      data += width;
+      count -= width;
+    }
+    result += Simd::reductionSum(sum0 + sum1);
+  }
+
+  for (; count > 0; data++, count--)
+    result += *data;
+
+  return result;
+}
+
+template<typename T, int width, typename Select, typename SelectSimd>
+static inline T simdReductionSelect(const T* data, size_t count, const Select& select, const SelectSimd& selectSimd)
+{
+  typedef SIMD<T, width> Simd;
+  assert(count > 0);
+
+  T result = *data;
+  for (; count > 0 && !Simd::isPointerAligned(data); data++, count--)
+    result = select(result, *data);
+
+  if (count >= (size_t)width)
+  {
+    typename Simd::Type value = Simd::load(data);
+    for (data += width, count -= width; count >= (size_t)width; data += width, count -= width)
+      value = selectSimd(value, Simd::load(data));
+
+    alignas(64) T values[width];
+    Simd::store(values, value);
+    for (int i = 0; i < width; i++)
+      result = select(result, values[i]);
+  }
+
+  for (; count > 0; data++, count--)
+    result = select(result, *data);
+
+  return result;
+}
+
+template<typename T, int width>
+static inline T reductionMin(const T* data, size_t count)
+{
+  typedef SIMD<T, width> Simd;
+  return simdReductionSelect<T, width>(data, count, [](T a, T b) { return std::min(a, b); },
+    [](typename Simd::Type a, typename Simd::Type b) { return Simd::min(a, b); });
+}
+
+template<typename T, int width>
+static inline T reductionMax(const T* data, size_t count)
+{
+  typedef SIMD<T, width> Simd;
+  return simdReductionSelect<T, width>(data, count, [](T a, T b) { return std::max(a, b); },
+    [](typename Simd::Type a, typename Simd::Type b) { return Simd::max(a, b); });
+}
+
+}
+
+}
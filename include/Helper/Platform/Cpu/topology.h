@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../os.h"
+#include "cpu.h"
+
+#ifdef PLATFORM_CPU_X86
+#  include "x86/x86.h"
+#endif
+
+#if defined(PLATFORM_OS_LINUX)
+#  include <dirent.h>
+#  include <pthread.h>
+#  include <sched.h>
+#elif defined(PLATFORM_OS_WINDOWS)
+// the min and max macros of windows.h break std::min and std::max in the files including this one
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#endif
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+struct LogicalCpu
+{
+  int id;      // os number of the logical cpu
+  int core;    // physical core, unique over all packages
+  int package;
+  int node;    // NUMA node
+};
+
+struct CpuTopology
+{
+  std::vector<LogicalCpu> cpus;
+  int coreCount = 0;
+  int packageCount = 0;
+  int nodeCount = 0;
+
+  inline const LogicalCpu* getCpu(int id) const;
+  inline std::vector<int> getNodeCpus(int node) const;
+};
+
+enum class CacheType
+{
+  Data,
+  Instruction,
+  Unified,
+};
+
+struct CpuCache
+{
+  int level;
+  CacheType type;
+  int size;          // bytes
+  int lineSize;
+  int associativity; // ways
+  int sharingCpus;   // logical cpus sharing an instance of the cache, cpuid reports the max addressable number
+};
+
+struct CacheTopology
+{
+  // caches of the first cpu ordered by level
+  std::vector<CpuCache> caches;
+
+  // data or unified cache of the level, null if unknown
+  inline const CpuCache* getDataCache(int level) const;
+  // bytes of the data cache of the level a logical cpu has if all of them are busy, 0 if unknown
+  inline int getSizePerCpu(int level) const;
+};
+
+// topology of the online cpus, detected once
+static inline const CpuTopology& getCpuTopology();
+// caches by cpuid leaf 4 (Intel) or 0x8000001D (AMD), by sysfs if cpuid doesn't tell, detected once
+static inline const CacheTopology& getCacheTopology();
+
+// side of a square tile of items of itemSize bytes taking half of the share of a logical cpu in the data cache of
+// the level, so a tile and the data it is combined with stay in the cache, a multiple of the items per cache line,
+// e.g. for blocked transposes and ThreadPool::parallelFor2D()
+static inline int getCacheTileSize(size_t itemSize, int level = 2);
+
+// logical cpus the current thread may run on, all online cpus if unknown
+static inline std::vector<int> getCurrentThreadAffinity();
+static inline bool setCurrentThreadAffinity(const std::vector<int>& cpus);
+
+// implementation
+
+inline const LogicalCpu* CpuTopology::getCpu(int id) const
+{
+  for (const LogicalCpu& cpu : cpus)
+  {
+    if (cpu.id == id)
+      return &cpu;
+  }
+  return nullptr;
+}
+
+inline std::vector<int> CpuTopology::getNodeCpus(int node) const
+{
+  std::vector<int> result;
+  for (const LogicalCpu& cpu : cpus)
+  {
+    if (cpu.node == node)
+      result.push_back(cpu.id);
+  }
+  return result;
+}
+
+inline const CpuCache* CacheTopology::getDataCache(int level) const
+{
+  for (const CpuCache& cache : caches)
+  {
+    if (cache.level == level && cache.type != CacheType::Instruction)
+      return &cache;
+  }
+  return nullptr;
+}
+
+inline int CacheTopology::getSizePerCpu(int level) const
+{
+  const CpuCache* cache = getDataCache(level);
+  return cache ? cache->size / std::max(cache->sharingCpus, 1) : 0;
+}
+
+#if defined(PLATFORM_OS_LINUX)
+static inline bool readSysfsInt(const char* path, int& value)
+{
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  bool result = fscanf(file, "%d", &value) == 1;
+  fclose(file);
+  return result;
+}
+
+// parses cpu list like "0-3,8,10-11"
+static inline std::vector<int> readSysfsCpuList(const char* path)
+{
+  std::vector<int> cpus;
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return cpus;
+
+  int first, last;
+  for (; fscanf(file, "%d", &first) == 1;)
+  {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-')
+    {
+      if (fscanf(file, "%d", &last) != 1)
+        break;
+      c = fgetc(file);
+    }
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+    if (c != ',')
+      break;
+  }
+
+  fclose(file);
+  return cpus;
+}
+
+static inline int readSysfsCpuNode(int cpu)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR* dir = opendir(path);
+  if (!dir)
+    return 0;
+
+  int node = 0;
+  for (dirent* entry; (entry = readdir(dir)) != nullptr;)
+  {
+    if (sscanf(entry->d_name, "node%d", &node) == 1)
+      break;
+  }
+
+  closedir(dir);
+  return node;
+}
+#endif
+
+#if defined(PLATFORM_OS_LINUX)
+static inline std::vector<CpuCache> readSysfsCaches()
+{
+  std::vector<CpuCache> caches;
+  char path[128];
+  for (int index = 0;; index++)
+  {
+    CpuCache cache = {0, CacheType::Unified, 0, 0, 0, 1};
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+    if (!readSysfsInt(path, cache.level))
+      break;
+
+    // size like "48K"
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+    FILE* file = fopen(path, "r");
+    if (file)
+    {
+      char unit = 0;
+      if (fscanf(file, "%d%c", &cache.size, &unit) >= 1)
+        cache.size *= unit == 'K' ? 1024 : unit == 'M' ? 1024 * 1024 : 1;
+      fclose(file);
+    }
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+    file = fopen(path, "r");
+    if (file)
+    {
+      char type[32] = {};
+      if (fscanf(file, "%31s", type) == 1)
+        cache.type = type[0] == 'D' ? CacheType::Data : type[0] == 'I' ? CacheType::Instruction : CacheType::Unified;
+      fclose(file);
+    }
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", index);
+    readSysfsInt(path, cache.lineSize);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/ways_of_associativity", index);
+    readSysfsInt(path, cache.associativity);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/shared_cpu_list", index);
+    cache.sharingCpus = std::max((int)readSysfsCpuList(path).size(), 1);
+
+    if (cache.size > 0)
+      caches.push_back(cache);
+  }
+  return caches;
+}
+#endif
+
+#ifdef PLATFORM_CPU_X86
+// leaf 4 and 0x8000001D have the same layout, a subleaf per cache until the null type
+static inline std::vector<CpuCache> readx86Caches(uint32_t leaf)
+{
+  std::vector<CpuCache> caches;
+  for (uint32_t index = 0; index < 16; index++)
+  {
+    uint32_t eax = x86cpuid(leaf, index, 0);
+    int type = eax & 0x1f;
+    if (type == 0)
+      break;
+
+    uint32_t ebx = x86cpuid(leaf, index, 1);
+    uint32_t ecx = x86cpuid(leaf, index, 2);
+    CpuCache cache;
+    cache.level = (eax >> 5) & 0x7;
+    cache.type = type == 1 ? CacheType::Data : type == 2 ? CacheType::Instruction : CacheType::Unified;
+    cache.lineSize = (ebx & 0xfff) + 1;
+    cache.associativity = ((ebx >> 22) & 0x3ff) + 1;
+    int partitions = ((ebx >> 12) & 0x3ff) + 1;
+    cache.size = cache.associativity * partitions * cache.lineSize * (int)(ecx + 1);
+    cache.sharingCpus = ((eax >> 14) & 0xfff) + 1;
+    caches.push_back(cache);
+  }
+  return caches;
+}
+#endif
+
+static inline CacheTopology detectCacheTopology()
+{
+  CacheTopology topology;
+
+#ifdef PLATFORM_CPU_X86
+  // "AuthenticAMD" and "HygonGenuine" report the caches by the extended leaf if they have the topology extensions
+  uint32_t vendor = x86cpuid(0, 0, 1);
+  bool amd = vendor == 0x68747541 || vendor == 0x6f677948;
+  bool topologyExtensions = x86cpuid(0x80000000, 0, 0) >= 0x8000001d && (x86cpuid(0x80000001, 0, 2) & (1 << 22));
+  if (amd && topologyExtensions)
+    topology.caches = readx86Caches(0x8000001d);
+  else if (!amd && x86cpuid(0, 0, 0) >= 4)
+    topology.caches = readx86Caches(4);
+#endif
+
+#if defined(PLATFORM_OS_LINUX)
+  if (topology.caches.empty())
+    topology.caches = readSysfsCaches();
+#endif
+
+  std::stable_sort(topology.caches.begin(), topology.caches.end(), [](const CpuCache& a, const CpuCache& b)
+  {
+    return a.level < b.level;
+  });
+
+  return topology;
+}
+
+static inline CpuTopology detectCpuTopology()
+{
+  CpuTopology topology;
+
+#if defined(PLATFORM_OS_LINUX)
+  char path[128];
+  std::vector<std::pair<int, int>> cores; // (package, core id) of the found cores
+  for (int id : readSysfsCpuList("/sys/devices/system/cpu/online"))
+  {
+    LogicalCpu cpu = {id, 0, 0, readSysfsCpuNode(id)};
+    int coreId = id;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", id);
+    readSysfsInt(path, cpu.package);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", id);
+    readSysfsInt(path, coreId);
+
+    std::pair<int, int> core(cpu.package, coreId);
+    auto it = std::find(cores.begin(), cores.end(), core);
+    cpu.core = (int)(it - cores.begin());
+    if (it == cores.end())
+      cores.push_back(core);
+
+    topology.cpus.push_back(cpu);
+  }
+#endif
+
+  if (topology.cpus.empty())
+  {
+    // no os topology info, logical processors of a core are assumed to be numbered consecutively
+    int count = std::max((int)std::thread::hardware_concurrency(), 1);
+#ifdef PLATFORM_CPU_X86
+    int threadsPerCore = getx86LogicalProcessorsPerCore();
+#else
+    int threadsPerCore = 1;
+#endif
+    for (int id = 0; id < count; id++)
+      topology.cpus.push_back(LogicalCpu{id, id / threadsPerCore, 0, 0});
+  }
+
+  for (const LogicalCpu& cpu : topology.cpus)
+  {
+    topology.coreCount = std::max(topology.coreCount, cpu.core + 1);
+    topology.packageCount = std::max(topology.packageCount, cpu.package + 1);
+    topology.nodeCount = std::max(topology.nodeCount, cpu.node + 1);
+  }
+
+  return topology;
+}
+
+static inline const CpuTopology& getCpuTopology()
+{
+  static const CpuTopology topology = detectCpuTopology();
+  return topology;
+}
+
+static inline const CacheTopology& getCacheTopology()
+{
+  static const CacheTopology topology = detectCacheTopology();
+  return topology;
+}
+
+static inline int getCacheTileSize(size_t itemSize, int level)
+{
+  // a common L2 share if the caches are unknown
+  const CacheTopology& topology = getCacheTopology();
+  const CpuCache* cache = topology.getDataCache(level);
+  int size = cache ? topology.getSizePerCpu(level) : 256 * 1024;
+  int lineSize = cache && cache->lineSize > 0 ? cache->lineSize : cacheLineSize;
+
+  itemSize = std::max<size_t>(itemSize, 1);
+  int lineItems = std::max((int)(lineSize / itemSize), 1);
+  int side = (int)std::sqrt((double)size / 2 / itemSize);
+  return std::max(side / lineItems * lineItems, lineItems);
+}
+
+static inline std::vector<int> getCurrentThreadAffinity()
+{
+  std::vector<int> cpus;
+#if defined(PLATFORM_OS_LINUX)
+  cpu_set_t set;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+  {
+    for (const LogicalCpu& cpu : getCpuTopology().cpus)
+    {
+      if (cpu.id < CPU_SETSIZE && CPU_ISSET(cpu.id, &set))
+        cpus.push_back(cpu.id);
+    }
+  }
+#endif
+  if (cpus.empty())
+  {
+    for (const LogicalCpu& cpu : getCpuTopology().cpus)
+      cpus.push_back(cpu.id);
+  }
+  return cpus;
+}
+
+static inline bool setCurrentThreadAffinity(const std::vector<int>& cpus)
+{
+#if defined(PLATFORM_OS_LINUX)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+  {
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(PLATFORM_OS_WINDOWS)
+  DWORD_PTR mask = 0;
+  for (int cpu : cpus)
+  {
+    if (cpu >= 0 && cpu < (int)sizeof(mask) * 8)
+      mask |= (DWORD_PTR)1 << cpu;
+  }
+  return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+}
+
+}
@@ -3,6 +3,7 @@
 #include <immintrin.h>
 
 #include "../../cpu.h"
+#include "../../features.h"
 #include "../x86.h"
 
 // x86 AVX simd functions
@@ -20,6 +21,7 @@
 #endif
 #if defined(PLATFORM_CPU_FEATURE_AVX)
 #include "simd_float_avx.h"
+#include "simd_double_avx.h"
 #endif
 
 namespace Platform
@@ -33,14 +35,15 @@ static inline bool isAVX2Enabled();
 
 // implementation
 
+// false if the OS doesn't save the YMM registers
 static inline bool isAVXEnabled()
 {
-  return getx86CpuFeaturesWord(2) & (1 << 28);
+  return CpuFeatures::get().avx;
 }
 
 static inline bool isAVX2Enabled()
 {
-  return getx86CpuExtendedFeaturesWord(1) & (1 << 5);
+  return CpuFeatures::get().avx2;
 }
 
 }
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "../simd_x86.h"
+
+#define PLATFORM_CPU_FEATURE_DOUBLEx4
+
+#if SIMD_DOUBLE_MAX_WIDTH < 4
+#undef SIMD_DOUBLE_MAX_WIDTH
+#define SIMD_DOUBLE_MAX_WIDTH 4
+#endif
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+static inline bool isAVXEnabled();
+
+static inline double reduce_mm256d(__m256d x256);
+
+template<>
+struct SIMD<double, 4> : public x86Simd<32>
+{
+  typedef __m256d Type;
+  typedef __m256i ConditionType;
+
+  static bool isSupported()
+  {
+    static bool avxEnabled = isAVXEnabled();
+    return avxEnabled;
+  }
+
+  static inline Type zero()
+  {
+    return _mm256_setzero_pd();
+  }
+
+  static inline Type populate(double value)
+  {
+    return _mm256_set1_pd(value);
+  }
+
+  static inline Type create(double v0, double v1, double v2, double v3)
+  {
+    return _mm256_set_pd(v3, v2, v1, v0);
+  }
+
+  static inline Type rotate(Type value)
+  {
+    // the components are swapped in the 128-bit lanes and then the swapped lanes are blended in
+    __m256d t0 = _mm256_permute_pd(value, 0x5);
+    __m256d t1 = _mm256_permute2f128_pd(t0, t0, 0x01);
+    return _mm256_blend_pd(t0, t1, 0xa);
+  }
+
+  static inline double least(Type value)
+  {
+    return _mm_cvtsd_f64(_mm256_castpd256_pd128(value));
+  }
+
+  static inline Type min(Type a, Type b)
+  {
+    return _mm256_min_pd(a, b);
+  }
+
+  static inline Type max(Type a, Type b)
+  {
+    return _mm256_max_pd(a, b);
+  }
+
+  static inline Type select(Type a, Type b, ConditionType condition)
+  {
+    return _mm256_or_pd(_mm256_and_pd(_mm256_castsi256_pd(condition), a), _mm256_andnot_pd(_mm256_castsi256_pd(condition), b));
+  }
+
+  static inline Type sqrt(Type value)
+  {
+    return _mm256_sqrt_pd(value);
+  }
+
+  static inline __m128i ifloor(Type value)
+  {
+    return _mm256_cvtpd_epi32(_mm256_floor_pd(value));
+  }
+
+  static inline __m128i iceil(Type value)
+  {
+    return _mm256_cvtpd_epi32(_mm256_ceil_pd(value));
+  }
+
+  static inline Type load(const double* src)
+  {
+    return _mm256_load_pd(src);
+  }
+
+  static inline Type loadUnaligned(const double* src)
+  {
+    return _mm256_loadu_pd(src);
+  }
+
+  static inline void store(double* dst, Type value)
+  {
+    _mm256_store_pd(dst, value);
+  }
+
+  static inline void storeUnaligned(double* dst, Type value)
+  {
+    _mm256_storeu_pd(dst, value);
+  }
+
+  static inline double reductionSum(Type value)
+  {
+    return reduce_mm256d(value);
+  }
+
+  static inline Type fromFloat(__m128 value)
+  {
+    return _mm256_cvtps_pd(value);
+  }
+
+  static inline __m128 toFloat(Type value)
+  {
+    return _mm256_cvtpd_ps(value);
+  }
+
+  static inline Type fromInt32(__m128i value)
+  {
+    return _mm256_cvtepi32_pd(value);
+  }
+
+  // rounded to nearest
+  static inline __m128i toInt32(Type value)
+  {
+    return _mm256_cvtpd_epi32(value);
+  }
+};
+
+static inline __m256d mul_add(__m256d t1, __m256d m1, __m256d m2)
+{
+  return _mm256_add_pd(t1, _mm256_mul_pd(m1, m2));
+}
+
+static inline __m256d mul_sub(__m256d me, __m256d m1, __m256d m2)
+{
+  return _mm256_sub_pd(me, _mm256_mul_pd(m1, m2));
+}
+
+}
+
+}
+
+#ifdef PLATFORM_COMPILER_MSVC
+// double AVX operators
+
+static inline __m256d operator-(__m256d a)
+{
+  return _mm256_sub_pd(_mm256_setzero_pd(), a);
+}
+
+static inline __m256d operator+(__m256d a, __m256d b)
+{
+  return _mm256_add_pd(a, b);
+}
+
+static inline __m256d operator-(__m256d a, __m256d b)
+{
+  return _mm256_sub_pd(a, b);
+}
+
+static inline __m256d operator*(__m256d a, __m256d b)
+{
+  return _mm256_mul_pd(a, b);
+}
+
+static inline __m256d operator/(__m256d a, __m256d b)
+{
+  return _mm256_div_pd(a, b);
+}
+
+static inline __m256d operator+=(__m256d& a, __m256d b)
+{
+  return a = _mm256_add_pd(a, b);
+}
+
+static inline __m256i operator<(__m256d a, __m256d b)
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_LT_OQ));
+}
+
+static inline __m256i operator<=(__m256d a, __m256d b)
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_LE_OQ));
+}
+
+static inline __m256i operator>(__m256d a, __m256d b)
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_GT_OQ));
+}
+
+static inline __m256i operator>=(__m256d a, __m256d b)
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_GE_OQ));
+}
+#endif
@@ -11,12 +11,6 @@
 #undef SIMD_FLOAT_MAX_WIDTH
 #define SIMD_FLOAT_MAX_WIDTH 8
 #endif
-/* TODO : implement
-#if SIMD_DOUBLE_MAX_WIDTH < 4
-#undef SIMD_DOUBLE_MAX_WIDTH
-#define SIMD_DOUBLE_MAX_WIDTH 4
-#endif
-*/
 
 namespace Platform
 {
@@ -253,6 +253,8 @@ inline void SIMD<int8_t, 32>::transpose4x8x8(Type* dst, Type w0, Type w1, Type w
 
 #ifdef PLATFORM_COMPILER_MSVC
 __forceinline // workaround for msvc inlining issue for that function
+#else
+inline
 #endif
 typename SIMD<int8_t, 32>::Type SIMD<int8_t, 32>::create4BitLookupTable(int8_t v0, int8_t v1, int8_t v2, int8_t v3, int8_t v4, int8_t v5, int8_t v6, int8_t v7, int8_t v8, int8_t v9, int8_t v10, int8_t v11, int8_t v12, int8_t v13, int8_t v14, int8_t v15)
 {
@@ -261,6 +263,8 @@ typename SIMD<int8_t, 32>::Type SIMD<int8_t, 32>::create4BitLookupTable(int8_t v
 
 #ifdef PLATFORM_COMPILER_MSVC
 __forceinline // workaround for msvc inlining issue for that function
+#else
+inline
 #endif
 typename SIMD<int8_t, 32>::Type SIMD<int8_t, 32>::lookup4BitKeyValues(Type keys, Type table)
 {
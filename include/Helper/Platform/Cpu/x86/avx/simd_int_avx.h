@@ -92,6 +92,8 @@ struct AvxIntSimd : public x86Simd<32>, public IntSimd<T, __m256i, __m256i>
   static inline Type mask(ConditionType condition);
   static inline Type select(ConditionType condition, Type a, Type b);
 
+  static inline T reductionSum(ParamType value);
+
   constexpr static int PreferedAlignment = 32;
 };
 
@@ -288,6 +290,19 @@ inline void AvxIntSimd<T>::storeHigh(T* dst, ParamType value)
   _mm_store_si128((__m128i*)dst, _mm256_extractf128_si256(value.value, 1));
 }
 
+template<typename T>
+inline T AvxIntSimd<T>::reductionSum(ParamType value)
+{
+  alignas(32) T values[32 / sizeof(T)];
+  store(values, value);
+
+  T result = values[0];
+  for (size_t i = 1; i < sizeof(values) / sizeof(T); i++)
+    result += values[i];
+
+  return result;
+}
+
 template<typename T>
 inline typename AvxIntSimd<T>::Type AvxIntSimd<T>::mask(ConditionType condition)
 {
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <emmintrin.h> // sse2
+
+#include "../simd_x86.h"
+
+#define PLATFORM_CPU_FEATURE_DOUBLEx2
+
+#if SIMD_DOUBLE_MAX_WIDTH < 2
+#undef SIMD_DOUBLE_MAX_WIDTH
+#define SIMD_DOUBLE_MAX_WIDTH 2
+#endif
+
+namespace Platform
+{
+
+namespace Cpu
+{
+
+static inline double reduce_mm128dSSE(__m128d x128);
+
+template<>
+struct SIMD<double, 2> : public x86Simd<16>
+{
+  typedef __m128d Type;
+  typedef __m128i ConditionType;
+
+  static constexpr bool isSupported()
+  {
+    return true;
+  }
+
+  static inline Type zero()
+  {
+    return _mm_setzero_pd();
+  }
+
+  static inline Type populate(double value)
+  {
+    return _mm_set1_pd(value);
+  }
+
+  static inline Type create(double v0, double v1)
+  {
+    return _mm_set_pd(v1, v0);
+  }
+
+  static inline Type rotate(Type value)
+  {
+    return _mm_shuffle_pd(value, value, 1);
+  }
+
+  static inline double least(Type value)
+  {
+    return _mm_cvtsd_f64(value);
+  }
+
+  static inline Type min(Type a, Type b)
+  {
+    return _mm_min_pd(a, b);
+  }
+
+  static inline Type max(Type a, Type b)
+  {
+    return _mm_max_pd(a, b);
+  }
+
+  static inline Type select(Type a, Type b, ConditionType condition)
+  {
+    return _mm_or_pd(_mm_and_pd(_mm_castsi128_pd(condition), a), _mm_andnot_pd(_mm_castsi128_pd(condition), b));
+  }
+
+  static inline Type sqrt(Type value)
+  {
+    return _mm_sqrt_pd(value);
+  }
+
+  // the results are in the 2 lower 32-bit components
+  static inline __m128i ifloor(Type value)
+  {
+#ifdef SIMD_SSE41_RUNTIME_SUPPORTED
+    return _mm_cvtpd_epi32(_mm_floor_pd(value));
+#else
+    __m128i ivalue = _mm_cvtpd_epi32(value);
+    // the 64-bit comparison masks are packed to the 2 lower 32-bit components, the upper ones stay zero
+    __m128i less = _mm_shuffle_epi32(_mm_castpd_si128(_mm_cmplt_pd(value, _mm_cvtepi32_pd(ivalue))), _MM_SHUFFLE(1, 1, 2, 0));
+
+    return _mm_sub_epi32(ivalue, _mm_and_si128(_mm_set_epi32(0, 0, 1, 1), less));
+#endif
+  }
+
+  static inline __m128i iceil(Type value)
+  {
+#ifdef SIMD_SSE41_RUNTIME_SUPPORTED
+    return _mm_cvtpd_epi32(_mm_ceil_pd(value));
+#else
+    __m128i ivalue = _mm_cvtpd_epi32(value);
+    __m128i greater = _mm_shuffle_epi32(_mm_castpd_si128(_mm_cmpgt_pd(value, _mm_cvtepi32_pd(ivalue))), _MM_SHUFFLE(1, 1, 2, 0));
+
+    return _mm_add_epi32(ivalue, _mm_and_si128(_mm_set_epi32(0, 0, 1, 1), greater));
+#endif
+  }
+
+  static inline Type load(const double* src)
+  {
+    return _mm_load_pd(src);
+  }
+
+  static inline Type loadUnaligned(const double* src)
+  {
+    return _mm_loadu_pd(src);
+  }
+
+  static inline void store(double* dst, Type value)
+  {
+    _mm_store_pd(dst, value);
+  }
+
+  static inline void storeUnaligned(double* dst, Type value)
+  {
+    _mm_storeu_pd(dst, value);
+  }
+
+  static inline double reductionSum(Type value)
+  {
+    return reduce_mm128dSSE(value);
+  }
+
+  // the 2 lower components of value
+  static inline Type fromFloat(__m128 value)
+  {
+    return _mm_cvtps_pd(value);
+  }
+
+  // the results are in the 2 lower components
+  static inline __m128 toFloat(Type value)
+  {
+    return _mm_cvtpd_ps(value);
+  }
+
+  // the 2 lower components of value
+  static inline Type fromInt32(__m128i value)
+  {
+    return _mm_cvtepi32_pd(value);
+  }
+
+  // rounded to nearest, the results are in the 2 lower components
+  static inline __m128i toInt32(Type value)
+  {
+    return _mm_cvtpd_epi32(value);
+  }
+};
+
+static inline __m128d mul_add(__m128d t1, __m128d m1, __m128d m2)
+{
+  return _mm_add_pd(t1, _mm_mul_pd(m1, m2));
+}
+
+static inline __m128d mul_sub(__m128d me, __m128d m1, __m128d m2)
+{
+  return _mm_sub_pd(me, _mm_mul_pd(m1, m2));
+}
+
+}
+
+}
+
+#ifdef PLATFORM_COMPILER_MSVC
+static inline __m128d operator-(__m128d a)
+{
+  return _mm_sub_pd(_mm_setzero_pd(), a);
+}
+
+static inline __m128d operator+(__m128d a, __m128d b)
+{
+  return _mm_add_pd(a, b);
+}
+
+static inline __m128d operator-(__m128d a, __m128d b)
+{
+  return _mm_sub_pd(a, b);
+}
+
+static inline __m128d operator*(__m128d a, __m128d b)
+{
+  return _mm_mul_pd(a, b);
+}
+
+static inline __m128d operator/(__m128d a, __m128d b)
+{
+  return _mm_div_pd(a, b);
+}
+
+static inline __m128d operator+=(__m128d& a, __m128d b)
+{
+  return a = _mm_add_pd(a, b);
+}
+
+static inline __m128i operator<(__m128d a, __m128d b)
+{
+  return _mm_castpd_si128(_mm_cmplt_pd(a, b));
+}
+
+static inline __m128i operator<=(__m128d a, __m128d b)
+{
+  return _mm_castpd_si128(_mm_cmple_pd(a, b));
+}
+
+static inline __m128i operator>(__m128d a, __m128d b)
+{
+  return _mm_castpd_si128(_mm_cmpgt_pd(a, b));
+}
+
+static inline __m128i operator>=(__m128d a, __m128d b)
+{
+  return _mm_castpd_si128(_mm_cmpge_pd(a, b));
+}
+#endif
@@ -238,6 +238,8 @@ inline void SIMD<int8_t, 16>::transpose2x8x8(Type* dst, Type w0, Type w1, Type w
 
 #ifdef PLATFORM_COMPILER_MSVC
 __forceinline // workaround for msvc inlining issue for that function
+#else
+inline
 #endif
 typename SIMD<int8_t, 16>::Type SIMD<int8_t, 16>::create4BitLookupTable(int8_t v0, int8_t v1, int8_t v2, int8_t v3, int8_t v4, int8_t v5, int8_t v6, int8_t v7, int8_t v8, int8_t v9, int8_t v10, int8_t v11, int8_t v12, int8_t v13, int8_t v14, int8_t v15)
 {
@@ -246,6 +248,8 @@ typename SIMD<int8_t, 16>::Type SIMD<int8_t, 16>::create4BitLookupTable(int8_t v
 
 #ifdef PLATFORM_COMPILER_MSVC
 __forceinline // workaround for msvc inlining issue for that function
+#else
+inline
 #endif
 typename SIMD<int8_t, 16>::Type SIMD<int8_t, 16>::lookup4BitKeyValues(Type keys, Type table)
 {
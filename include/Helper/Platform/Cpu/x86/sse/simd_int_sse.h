@@ -84,6 +84,8 @@ struct SseIntSimd : public x86Simd<16>, public IntSimd<T, __m128i, __m128i>
 
   static inline Type mask(ConditionType condition);
   static inline Type select(ConditionType condition, Type a, Type b);
+
+  static inline T reductionSum(ParamType value);
 };
 
 static inline void transposeSseInt16(__m128i& w0, __m128i& w1, __m128i& w2, __m128i& w3, __m128i& w4, __m128i& w5, __m128i& w6, __m128i& w7);
@@ -253,6 +255,19 @@ inline void SseIntSimd<T>::store(T* dst, ParamType value)
   _mm_store_si128((__m128i*)dst, value.value);
 }
 
+template<typename T>
+inline T SseIntSimd<T>::reductionSum(ParamType value)
+{
+  alignas(16) T values[16 / sizeof(T)];
+  store(values, value);
+
+  T result = values[0];
+  for (size_t i = 1; i < sizeof(values) / sizeof(T); i++)
+    result += values[i];
+
+  return result;
+}
+
 template<typename T>
 inline typename SseIntSimd<T>::Type SseIntSimd<T>::mask(ConditionType condition)
 {
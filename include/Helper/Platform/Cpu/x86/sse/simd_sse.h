@@ -3,6 +3,7 @@
 #include <pmmintrin.h> // sse/sse2/sse3
 
 #include "../../cpu.h"
+#include "../../features.h"
 #include "../x86.h"
 
 #include "simd_int8_sse.h"
@@ -14,16 +15,10 @@
 #include "simd_uint32_sse.h"
 #include "simd_uint64_sse.h"
 #include "simd_float_sse.h"
+#include "simd_double_sse.h"
 
 // x86 SSE simd functions
 
-/* TODO : implement
-#if SIMD_DOUBLE_MAX_WIDTH < 2
-#undef SIMD_DOUBLE_MAX_WIDTH
-#define SIMD_DOUBLE_MAX_WIDTH 2
-#endif
-*/
-
 namespace Platform
 {
 
@@ -43,17 +38,17 @@ template<typename FloatType> static inline FloatType mulZeroPaddedVectorsSSE3(co
 
 static inline bool isSSE3Enabled()
 {
-  return getx86CpuFeaturesWord(2) & (1 << 0);
+  return CpuFeatures::get().sse3;
 }
 
 static inline bool isSSSE3Enabled()
 {
-  return getx86CpuFeaturesWord(2) & (1 << 9);
+  return CpuFeatures::get().ssse3;
 }
 
 static inline bool isSSE41Enabled()
 {
-  return getx86CpuFeaturesWord(2) & (1 << 19);
+  return CpuFeatures::get().sse41;
 }
 
 template<typename FloatType> static inline constexpr int floatsPerSimdSSE()
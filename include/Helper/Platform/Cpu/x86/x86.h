@@ -29,6 +29,23 @@ static inline uint32_t x86cpuid(uint32_t eax, uint32_t ecx, int wordIndex)
   return info[wordIndex];
 }
 
+// extended control register, XCR0 tells the register states saved by the OS, valid only if cpuid reports OSXSAVE
+static inline uint64_t x86xgetbv(uint32_t index)
+{
+#if defined(PLATFORM_COMPILER_GNU) && !defined(PLATFORM_COMPILER_EMSCRIPTEN)
+  uint32_t eax, edx;
+  // xgetbv opcode, the mnemonic needs -mxsave
+  asm(".byte 0x0f, 0x01, 0xd0"
+    : "=a" (eax), "=d" (edx)
+    : "c" (index));
+  return ((uint64_t)edx << 32) | eax;
+#elif defined(PLATFORM_COMPILER_MSVC)
+  return _xgetbv(index);
+#else
+#error "unsupported compiler"
+#endif
+}
+
 static inline uint32_t getx86CpuFeaturesWord(int wordIndex)
 {
   return x86cpuid(1, 0, wordIndex);
@@ -42,6 +59,16 @@ static inline uint32_t getx86CpuExtendedFeaturesWord(int wordIndex)
   return x86cpuid(7, 0, wordIndex);
 }
 
+// number of logical processors sharing a core (SMT), from the first level of the topology leaf
+static inline int getx86LogicalProcessorsPerCore()
+{
+  if (x86cpuid(0, 0, 0) < 0xb || ((x86cpuid(0xb, 0, 2) >> 8) & 0xff) != 1)
+    return 1;
+
+  int count = x86cpuid(0xb, 0, 1) & 0xffff;
+  return count > 0 ? count : 1;
+}
+
 }
 
 }
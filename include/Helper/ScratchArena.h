@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace Helper
+{
+
+// bump pointer allocator for temporary buffers, the memory is given back only by rewind() and reset() and the blocks
+// are kept for reuse, so a steady state workload doesn't allocate
+class ScratchArena
+{
+public:
+  struct Block;
+
+  // position of the arena, see rewind()
+  struct Marker
+  {
+    Block* m_block;
+    size_t m_offset;
+  };
+
+  // fits PreferedAlignment of every SIMD type
+  constexpr static size_t defaultAlignment = 64;
+
+  inline explicit ScratchArena(size_t blockSize = 64 * 1024);
+  inline ~ScratchArena();
+
+  // uninitialized memory for count objects of type T, alignment should be power of 2
+  template<typename T>
+  inline T* allocate(size_t count, size_t alignment = defaultAlignment);
+  inline void* allocateBytes(size_t size, size_t alignment = defaultAlignment);
+
+  inline Marker getMarker() const;
+  // frees the memory allocated after the marker was taken
+  inline void rewind(const Marker& marker);
+  // frees all the memory, the blocks used by the previous allocations are merged to a single one
+  inline void reset();
+
+  inline size_t getCapacity() const;
+
+  struct Block
+  {
+    Block* m_next;
+    size_t m_size;
+
+    inline unsigned char* data();
+  };
+
+private:
+  ScratchArena(const ScratchArena& other) = delete;
+  ScratchArena& operator=(const ScratchArena& other) = delete;
+
+  inline Block* allocateBlock(size_t size);
+  inline void freeBlocks();
+
+  Block* m_blocks = nullptr;
+  Block* m_current = nullptr;
+  size_t m_offset = 0;
+  size_t m_blockSize;
+  size_t m_capacity = 0;
+};
+
+// implementation
+
+inline ScratchArena::ScratchArena(size_t blockSize) : m_blockSize(blockSize)
+{
+}
+
+inline ScratchArena::~ScratchArena()
+{
+  freeBlocks();
+}
+
+template<typename T>
+inline T* ScratchArena::allocate(size_t count, size_t alignment)
+{
+  return (T*)allocateBytes(sizeof(T) * count, alignment < alignof(T) ? alignof(T) : alignment);
+}
+
+inline void* ScratchArena::allocateBytes(size_t size, size_t alignment)
+{
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+  for (Block* block = m_current;;)
+  {
+    if (block)
+    {
+      uintptr_t data = (uintptr_t)block->data();
+      uintptr_t p = (data + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+      if (p + size <= data + block->m_size)
+      {
+        m_current = block;
+        m_offset = p + size - data;
+        return (void*)p;
+      }
+
+      // the next block is left from a previous allocation
+      if (block->m_next)
+      {
+        block = block->m_next;
+        m_offset = 0;
+        continue;
+      }
+    }
+
+    Block* newBlock = allocateBlock(size + alignment > m_blockSize ? size + alignment : m_blockSize);
+    if (block)
+      block->m_next = newBlock;
+    else
+      m_blocks = newBlock;
+    block = newBlock;
+    m_offset = 0;
+  }
+}
+
+inline ScratchArena::Marker ScratchArena::getMarker() const
+{
+  return Marker{m_current, m_offset};
+}
+
+inline void ScratchArena::rewind(const Marker& marker)
+{
+  if (!marker.m_block || (marker.m_block == m_blocks && marker.m_offset == 0))
+  {
+    reset();
+    return;
+  }
+
+  m_current = marker.m_block;
+  m_offset = marker.m_offset;
+}
+
+inline void ScratchArena::reset()
+{
+  if (m_blocks && m_blocks->m_next)
+  {
+    size_t capacity = m_capacity;
+    freeBlocks();
+    m_blocks = allocateBlock(capacity);
+  }
+
+  m_current = m_blocks;
+  m_offset = 0;
+}
+
+inline size_t ScratchArena::getCapacity() const
+{
+  return m_capacity;
+}
+
+inline unsigned char* ScratchArena::Block::data()
+{
+  return (unsigned char*)this + ((sizeof(Block) + defaultAlignment - 1) & ~(defaultAlignment - 1));
+}
+
+inline ScratchArena::Block* ScratchArena::allocateBlock(size_t size)
+{
+  // the block header and the data are placed to the same allocation, the data is aligned by defaultAlignment
+  size_t headerSize = (sizeof(Block) + defaultAlignment - 1) & ~(defaultAlignment - 1);
+  void* memory = malloc(headerSize + size + defaultAlignment);
+  if (!memory)
+    throw std::bad_alloc();
+
+  uintptr_t aligned = ((uintptr_t)memory + sizeof(void*) + defaultAlignment - 1) & ~(uintptr_t)(defaultAlignment - 1);
+  ((void**)aligned)[-1] = memory;
+
+  Block* block = (Block*)aligned;
+  block->m_next = nullptr;
+  block->m_size = size;
+  m_capacity += size;
+  return block;
+}
+
+inline void ScratchArena::freeBlocks()
+{
+  for (Block* block = m_blocks; block;)
+  {
+    Block* next = block->m_next;
+    free(((void**)block)[-1]);
+    block = next;
+  }
+
+  m_blocks = nullptr;
+  m_current = nullptr;
+  m_offset = 0;
+  m_capacity = 0;
+}
+
+}
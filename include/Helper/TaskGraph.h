@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace Helper
+{
+
+// graph of jobs with dependencies run in the ThreadPool, a node is run as soon as all its predecessors are finished,
+// the graph is built once and may be run any number of times
+class TaskGraph
+{
+public:
+  inline TaskGraph(ThreadPool& threadPool);
+  // waits for the running graph
+  inline ~TaskGraph();
+
+  // adds a node running f after the given nodes, returns the index of the node
+  inline int addNode(const std::function<void()>& f, std::initializer_list<int> predecessors = {});
+  // node successor is run after node predecessor is finished
+  inline void addDependency(int predecessor, int successor);
+
+  inline int getNodeCount() const;
+
+  // runs all the nodes and waits for them, the waiting thread runs queued pool jobs meanwhile
+  inline void run();
+  // starts the nodes without waiting, the graph should not be modified or started again until wait() returns
+  inline void start();
+  inline void wait();
+
+private:
+  TaskGraph(const TaskGraph& other) = delete;
+  TaskGraph& operator=(const TaskGraph& other) = delete;
+
+  struct Node
+  {
+    std::function<void()> m_function;
+    std::vector<int> m_successors;
+    int m_predecessorCount = 0;
+    std::atomic<int> m_pendingPredecessors{0};
+  };
+
+  inline void update();
+  inline void runNode(int index);
+
+  ThreadPool::TaskGroup m_group;
+  std::deque<Node> m_nodes;
+  std::vector<int> m_roots;
+  bool m_modified = false;
+};
+
+// implementation
+
+inline TaskGraph::TaskGraph(ThreadPool& threadPool) : m_group(threadPool)
+{
+}
+
+inline TaskGraph::~TaskGraph()
+{
+  wait();
+}
+
+inline int TaskGraph::addNode(const std::function<void()>& f, std::initializer_list<int> predecessors)
+{
+  assert(m_group.getPendingJobCount() == 0);
+
+  m_nodes.emplace_back();
+  m_nodes.back().m_function = f;
+  m_modified = true;
+
+  int index = (int)m_nodes.size() - 1;
+  for (int predecessor : predecessors)
+    addDependency(predecessor, index);
+  return index;
+}
+
+inline void TaskGraph::addDependency(int predecessor, int successor)
+{
+  assert(m_group.getPendingJobCount() == 0);
+  assert(predecessor >= 0 && predecessor < (int)m_nodes.size() && successor >= 0 && successor < (int)m_nodes.size());
+
+  m_nodes[predecessor].m_successors.push_back(successor);
+  m_nodes[successor].m_predecessorCount++;
+  m_modified = true;
+}
+
+inline int TaskGraph::getNodeCount() const
+{
+  return (int)m_nodes.size();
+}
+
+inline void TaskGraph::run()
+{
+  start();
+  wait();
+}
+
+inline void TaskGraph::start()
+{
+  assert(m_group.getPendingJobCount() == 0);
+
+  if (m_modified)
+    update();
+
+  for (Node& node : m_nodes)
+    node.m_pendingPredecessors.store(node.m_predecessorCount, std::memory_order_relaxed);
+
+  for (int root : m_roots)
+    m_group.run([this, root]() { runNode(root); });
+}
+
+inline void TaskGraph::wait()
+{
+  m_group.wait();
+}
+
+inline void TaskGraph::update()
+{
+  m_roots.clear();
+  for (int i = 0; i < (int)m_nodes.size(); i++)
+  {
+    if (m_nodes[i].m_predecessorCount == 0)
+      m_roots.push_back(i);
+  }
+
+#ifndef NDEBUG
+  // the nodes of a cycle would never run
+  std::vector<int> pending(m_nodes.size());
+  std::vector<int> ready = m_roots;
+  for (int i = 0; i < (int)m_nodes.size(); i++)
+    pending[i] = m_nodes[i].m_predecessorCount;
+  for (size_t i = 0; i < ready.size(); i++)
+  {
+    for (int successor : m_nodes[ready[i]].m_successors)
+    {
+      if (--pending[successor] == 0)
+        ready.push_back(successor);
+    }
+  }
+  assert(ready.size() == m_nodes.size() && "TaskGraph has a cycle");
+#endif
+
+  m_modified = false;
+}
+
+inline void TaskGraph::runNode(int index)
+{
+  // the first successor made ready by the node is run by the same thread without queueing, it likely uses the data
+  // the node has just produced
+  for (; index >= 0;)
+  {
+    Node& node = m_nodes[index];
+    if (node.m_function)
+      node.m_function();
+
+    index = -1;
+    for (int successor : node.m_successors)
+    {
+      if (m_nodes[successor].m_pendingPredecessors.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        continue;
+
+      if (index < 0)
+        index = successor;
+      else
+        m_group.run([this, successor]() { runNode(successor); });
+    }
+  }
+}
+
+}
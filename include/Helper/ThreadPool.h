@@ -1,9 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "CancellationToken.h"
+#include "InlineFunction.h"
+#include "ScratchArena.h"
+#include "TimerWheel.h"
+#include "Trace.h"
+#include "Platform/Cpu/cpu.h"
+#include "Platform/Cpu/intrinsics.h"
+#include "Platform/Cpu/topology.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#  include <coroutine>
+#  define HELPER_COROUTINES
+#endif
+
+// #define HELPER_THREADPOOL_STATISTICS // collect ThreadPool::Statistics
 
 namespace Helper
 {
@@ -13,66 +39,633 @@ class ThreadPool
 public:
   typedef std::function<void(const void*)> CommonThreadFunction;
 
+  enum class ThreadAffinity
+  {
+    None, // threads are not bound to cpus
+    Core, // every thread is bound to a single logical cpu, the physical cores and NUMA nodes are used evenly
+    Node, // every thread is bound to the cpus of a NUMA node, the nodes are used evenly
+  };
+
+  enum class IdlePolicy
+  {
+    Sleep, // idle threads sleep until a job is added
+    Spin,  // idle threads poll for jobs a while before sleeping, the polling time adapts to how soon the jobs come
+    Hot,   // idle threads poll for jobs until the policy is changed, for bursts of short jobs
+  };
+
+  enum class Priority
+  {
+    Normal,
+    High, // the jobs are taken before the normal ones by every thread, and only by the threads reserved for them
+  };
+
+  struct Options
+  {
+    explicit Options(int threadCount = -1) : threadCount(threadCount) {}
+
+    // -1 means a thread per available logical cpu, the max number of threads of an elastic pool
+    int threadCount;
+    ThreadAffinity affinity = ThreadAffinity::None;
+    // logical cpus the threads may run on, empty means the cpus available to the thread creating the pool
+    std::vector<int> cpus;
+    // capacity of the lock-free queue for jobs added outside of the pool threads, rounded up to power of 2
+    size_t queueCapacity = 1024;
+    // max number of jobs a pool thread moves from the shared queue to its own queue at once
+    int batchSize = 16;
+    IdlePolicy idlePolicy = IdlePolicy::Spin;
+    // max number of pause instructions an idle or waiting thread polls for before sleeping
+    int spinCount = 4096;
+    // number of threads running only the jobs of Priority::High, so they don't wait for the long normal jobs to finish
+    int highPriorityThreads = 0;
+    // microseconds per tick of the timers
+    int timerResolution = 1000;
+    // elastic pool: the threads are started when the queued jobs need them and at least minThreadCount of them
+    // are kept, 0 starts none until the first job, -1 starts all of them at once, the threads reserved for high
+    // priority jobs are always started
+    int minThreadCount = -1;
+    // milliseconds an idle thread above minThreadCount waits for jobs before exiting, 0 keeps the started threads
+    int idleTimeout = 0;
+  };
+
+  // counters collected if HELPER_THREADPOOL_STATISTICS is defined, all of them are zero otherwise,
+  // the counters only grow, so the rates are the differences of two snapshots
+  struct Statistics
+  {
+    // numbers of durations by ticks of Platform::Cpu::readTimestampCounter(), bucket i counts the durations
+    // in [2^i, 2^(i + 1)) ticks, bucket 0 counts the ones in [0, 2)
+    struct Histogram
+    {
+      constexpr static int bucketCount = 48;
+      uint64_t counts[bucketCount] = {};
+
+      inline uint64_t getCount() const;
+      // upper bound in ticks of the given fraction (0..1) of the durations
+      inline uint64_t getPercentile(double fraction) const;
+    };
+
+    struct ThreadStatistics
+    {
+      uint64_t jobCount = 0;
+      uint64_t stealCount = 0;
+      uint64_t busyTime = 0; // nanoseconds running jobs
+      uint64_t idleTime = 0; // nanoseconds polling or sleeping, pool threads only, added when the thread wakes up
+    };
+
+    // pool threads, the last item is for the threads outside of the pool running pool jobs while waiting
+    std::vector<ThreadStatistics> threads;
+    // time from adding a job to its start
+    Histogram queueDelay;
+    Histogram runTime;
+    uint64_t jobCount = 0;
+    uint64_t stealCount = 0;
+    // failed CAS of the shared queues and locks of the thread queues found taken
+    uint64_t contentionCount = 0;
+    double nanosecondsPerTick = 0;
+  };
+
+  typedef TimerWheel::TimerId TimerId;
+
+  // max size of a callable passed to submit()
+  constexpr static size_t jobCapacity = 7 * sizeof(void*);
+  // max size of a result returned by a submitted callable
+  constexpr static size_t futureResultCapacity = 64;
+
+  template<typename R> class Future;
+#ifdef HELPER_COROUTINES
+  class ScheduleAwaiter;
+  class GroupAwaiter;
+#endif
+
+  enum class Partitioning
+  {
+    Static,  // the range is split to equal parts, one per thread
+    Dynamic, // threads take grain sized chunks until the range is done
+    Guided,  // chunk size decreases from (rest of range) / (2 * thread count) to grain
+    // the range is split to equal parts, one per pool thread taking the normal jobs whatever thread calls it, each part is given
+    // to its own job, so f gets the same subranges on every run and the threads don't share any counter
+    Deterministic,
+  };
+
+  // set of jobs with own completion tracking, so independent users of the pool don't wait for each other's jobs
+  class TaskGroup
+  {
+  public:
+    inline TaskGroup(ThreadPool& threadPool, Priority priority = Priority::Normal);
+    // waits for the jobs of the group
+    inline ~TaskGroup();
+
+    inline ThreadPool& getThreadPool() const;
+    inline Priority getPriority() const;
+    inline int getPendingJobCount() const;
+
+    // node is a NUMA node hint, the job is queued for the threads of that node if the pool has them,
+    // the hint is ignored for Priority::High
+    inline bool addJob(const std::function<void()>& job, int node = -1);
+    // the job is dropped without running if the token is cancelled before the job starts
+    inline bool addJob(const std::function<void()>& job, const CancellationToken& token, int node = -1);
+    // runs f() in the pool, the callable is kept in the job slot without allocation
+    template<typename F>
+    inline void run(F&& f, int node = -1);
+    template<typename F>
+    inline void run(F&& f, const CancellationToken& token, int node = -1);
+    // waits until all jobs of the group are finished, the waiting thread runs queued pool jobs meanwhile,
+    // the jobs of the group being run by the calling thread itself are not waited
+    inline void wait();
+
+    // the queued jobs of a cancelled group are dropped without running, the running ones may poll
+    // JobContext::isCancelled(), the group stays cancelled
+    inline void cancel();
+    inline bool isCancelled() const;
+    // the group is cancelled with the token too, e.g. by its deadline, the token should be set before adding the jobs
+    inline void setCancellationToken(const CancellationToken& token);
+    inline const CancellationToken& getCancellationToken() const;
+
+#ifdef HELPER_COROUTINES
+    // co_await group.schedule() resumes the coroutine as a job of the group, so the group should not be destroyed
+    // by the coroutine, e.g. be its local variable
+    inline ScheduleAwaiter schedule();
+    // co_await group resumes the coroutine by a pool job when all jobs of the group are finished, no thread is held
+    // meanwhile
+    inline GroupAwaiter operator co_await();
+#endif
+
+  private:
+    friend class ThreadPool;
+
+    TaskGroup(const TaskGroup& other) = delete;
+    TaskGroup& operator=(const TaskGroup& other) = delete;
+
+    ThreadPool& m_threadPool;
+    Priority m_priority;
+    std::atomic<int> m_pendingJobs{0};
+    std::atomic<bool> m_cancelled{false};
+    CancellationToken m_cancellationToken;
+  };
+
+  // state of the thread running a job, the job gets it by getJobContext()
+  class JobContext
+  {
+  public:
+    // -1 if the job is run by a thread waiting for pool jobs
+    inline int getThreadIndex() const;
+    // NUMA node the thread is bound to, -1 if it is not
+    inline int getNode() const;
+    // temporary memory of the job aligned by ScratchArena::defaultAlignment, freed when the job returns
+    inline ScratchArena& getScratchArena();
+    // the running job or its group is cancelled, a long job may poll it to stop early
+    inline bool isCancelled() const;
+
+  private:
+    friend class ThreadPool;
+
+    int m_threadIndex = -1;
+    int m_node = -1;
+    ScratchArena m_scratchArena;
+  };
+
   inline ThreadPool(int threadCount = -1);
+  inline ThreadPool(const Options& options);
   inline ~ThreadPool();
 
   inline int getThreadCount() const;
+  // number of started threads, less than getThreadCount() for an elastic pool
+  inline int getActiveThreadCount() const;
+  // starts all the threads and makes each of them touch stackSize bytes of its stack and its scratch arena,
+  // so the page faults don't happen in a latency critical phase, waits until every thread has done it, so the pool
+  // should be idle, the threads above Options::minThreadCount exit again after the idle timeout,
+  // called from a pool job it warms up the calling thread only
+  inline void warmUp(size_t stackSize = 256 * 1024);
+  // number of jobs waiting to be run
+  inline int getQueuedJobCount(Priority priority) const;
+  inline Statistics getStatistics() const;
+
+  inline IdlePolicy getIdlePolicy() const;
+  // may be switched at any time, e.g. to IdlePolicy::Hot for a burst of jobs and back to IdlePolicy::Spin after it
+  inline void setIdlePolicy(IdlePolicy policy);
 
   inline void setCommonThreadFunction(const CommonThreadFunction& f);
   inline bool addJob(const void* threadData);
   inline bool addJobs(const void* const * start, const void* const * end);
   inline bool addJob(const std::function<void()>& job);
+  inline bool addJob(const std::function<void()>& job, const CancellationToken& token);
+  // waits for the jobs added by addJob(), addJobs() and submit(), the jobs of task groups are waited by TaskGroup::wait(),
+  // the waiting thread runs queued pool jobs meanwhile
   inline void waitJobs();
 
+  // runs f() in the pool, the callable is kept in the job slot and the result state is reused, so nothing is allocated
+  // in the steady state
+  template<typename F>
+  inline Future<typename std::decay<decltype(std::declval<typename std::decay<F>::type&>()())>::type> submit(F&& f, int node = -1);
+
+  // calls f(begin, end) for subranges of [begin, end) in parallel, the calling thread processes a part of the range too,
+  // subrange bounds are multiples of grain relative to begin, grain <= 0 selects it automatically,
+  // the parts run with the priority of the calling job
+  template<typename Function>
+  inline void parallelFor(int64_t begin, int64_t end, int64_t grain, const Function& f, Partitioning partitioning = Partitioning::Dynamic);
+  // calls f(x0, x1, y0, y1) in parallel for the tiles of [x0, x1) x [y0, y1) area, a tile side <= 0 is the whole side
+  // of the area, or the side of Platform::Cpu::getCacheTileSize(itemSize) if the bytes per item are given
+  template<typename Function>
+  inline void parallelFor2D(int x0, int x1, int y0, int y1, int tileWidth, int tileHeight, const Function& f,
+    Partitioning partitioning = Partitioning::Dynamic, size_t itemSize = 0);
+
+  // reduces [begin, end) in parallel: kernel(first, last) returns the result of a grain of the range, e.g. computed by
+  // Platform::Cpu::reductionSum(), the range is split to at most 8 parts per thread of consecutive grains, the grain
+  // results are combined by combine(a, b) in order inside of a part and the part results pairwise in the order of
+  // the parts, so the result doesn't depend on the scheduling, identity is the result of an empty range, the automatic
+  // grain and the parts depend on the pool size only, so the floating point results are reproducible with the same pool
+  template<typename T, typename Kernel, typename Combine>
+  inline T parallelReduce(int64_t begin, int64_t end, int64_t grain, const T& identity, const Kernel& kernel, const Combine& combine);
+
+  // context of the calling thread, valid for the threads not running pool jobs too
+  static inline JobContext& getJobContext();
+
+  // runs f in the pool after the delay, the timers are fired by the pool threads between the jobs, so no thread
+  // is spent on them, the fired jobs are not waited by waitJobs(), a pool without threads, e.g. ThreadPool() on
+  // a single cpu, can't fire them and returns 0, which is not a valid id
+  inline TimerId scheduleAfter(std::chrono::nanoseconds delay, const std::function<void()>& f);
+  // runs f every period, a run is not delayed by the previous one still running, the runs missed by the busy pool
+  // are skipped
+  inline TimerId scheduleEvery(std::chrono::nanoseconds period, const std::function<void()>& f);
+  // returns false if the timer has fired already or is cancelled, the job of a fired timer is run anyway
+  inline bool cancelTimer(TimerId id);
+
+#ifdef HELPER_COROUTINES
+  // co_await pool.schedule() resumes the coroutine as a job of the pool, the jobs are waited by waitJobs()
+  inline ScheduleAwaiter schedule();
+#endif
+
 private:
   inline ThreadPool(const ThreadPool& other) = delete;
   inline ThreadPool& operator=(const ThreadPool& other) = delete;
 
+  struct Job
+  {
+    InlineFunction<void(), jobCapacity + sizeof(void*)> m_function;
+    const void* m_data = nullptr;
+    TaskGroup* m_group = nullptr;
+    CancellationToken m_cancellationToken;
+    // the jobs resuming coroutines are run even if their group is cancelled
+    bool m_cancellable = true;
+#ifdef HELPER_THREADPOOL_STATISTICS
+    uint64_t m_queuedTicks = 0;
+#endif
+  };
+
+  // result of a submitted job shared by the job and its future, released by both of them
+  struct FutureState
+  {
+    std::atomic<int> m_references;
+    std::atomic<bool> m_ready;
+    ThreadPool* m_threadPool;
+    void (*m_destroyResult)(void* result);
+    FutureState* m_next;
+    alignas(std::max_align_t) unsigned char m_result[futureResultCapacity];
+
+    static inline FutureState* create(ThreadPool* threadPool);
+    inline void setReady();
+    inline void release();
+  };
+
+  // per thread list of released future states
+  struct FutureStateCache
+  {
+    FutureState* m_states = nullptr;
+    int m_count = 0;
+
+    inline ~FutureStateCache();
+  };
+
+  template<typename R> struct FutureResult;
+
+  // per thread job queue: the owner thread pushes and pops jobs at the back, other threads steal them from the front
+  class JobDeque
+  {
+  public:
+    inline void reserve();
+    inline void push(Job&& job);
+    inline void push(Job* jobs, size_t count);
+    inline bool pop(Job& job);
+    inline bool steal(Job& job);
+    inline bool steal(Job& job, const TaskGroup* group);
+#ifdef HELPER_THREADPOOL_STATISTICS
+    inline uint64_t getContentionCount() const;
+#endif
+
+  private:
+    inline std::unique_lock<std::mutex> lock();
+    inline void grow();
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+    std::atomic<uint64_t> m_contentionCount{0};
+#endif
+    std::mutex m_mutex;
+    std::vector<Job> m_jobs; // ring buffer, size is zero or power of 2
+    size_t m_head = 0;
+    size_t m_tail = 0;
+  };
+
+  // bounded multi producer/multi consumer ring buffer, a cell is free for the producer of position p when its sequence is p
+  // and is ready for the consumer when its sequence is p + 1
+  class JobQueue
+  {
+  public:
+    inline JobQueue(size_t capacity);
+    inline ~JobQueue();
+
+    inline size_t push(Job* jobs, size_t count);
+    inline size_t pop(Job* jobs, size_t count);
+#ifdef HELPER_THREADPOOL_STATISTICS
+    inline uint64_t getContentionCount() const;
+#endif
+
+  private:
+    struct Cell
+    {
+      std::atomic<size_t> m_sequence;
+      Job m_job;
+    };
+
+    Cell* m_cells;
+    size_t m_mask;
+    char m_padding0[Platform::Cpu::cacheLineSize];
+    std::atomic<size_t> m_pushPosition{0};
+    char m_padding1[Platform::Cpu::cacheLineSize];
+    std::atomic<size_t> m_popPosition{0};
+    char m_padding2[Platform::Cpu::cacheLineSize];
+#ifdef HELPER_THREADPOOL_STATISTICS
+    std::atomic<uint64_t> m_contentionCount{0};
+#endif
+  };
+
+  struct Counters
+  {
+#ifdef HELPER_THREADPOOL_STATISTICS
+    std::atomic<uint64_t> m_jobCount{0};
+    std::atomic<uint64_t> m_stealCount{0};
+    std::atomic<uint64_t> m_busyTicks{0};
+    std::atomic<uint64_t> m_idleTicks{0};
+    std::atomic<uint64_t> m_queueDelay[Statistics::Histogram::bucketCount] = {};
+    std::atomic<uint64_t> m_runTime[Statistics::Histogram::bucketCount] = {};
+    // the counters of a pool thread are changed by the thread only, the ones of the other threads are shared
+    bool m_shared = false;
+
+    inline void add(std::atomic<uint64_t>& counter, uint64_t value);
+    inline void addDuration(std::atomic<uint64_t>* histogram, uint64_t ticks);
+    inline void collect(Statistics::ThreadStatistics& thread, Statistics& statistics, double nanosecondsPerTick) const;
+#endif
+  };
+
   struct Thread
   {
     std::thread m_thread;
-    Thread* m_next = nullptr;
     ThreadPool* m_threadPool = nullptr;
-    std::condition_variable m_condition;
-    std::function<void()> m_job;
-    const void* m_data = nullptr;
+    int m_index = 0;
+    int m_node = -1;
+    std::vector<int> m_cpus;
+    // threads to steal jobs from, the threads of the same node go first
+    std::vector<int> m_victims;
+    JobDeque m_jobs;
+    // jobs taken from the shared queue at once, allocated by the thread, so taking them doesn't construct any
+    std::vector<Job> m_batch;
+    JobContext m_context;
+    Counters m_counters;
+    // runs only the jobs of Priority::High
+    bool m_highPriority = false;
+    // current polling time of IdlePolicy::Spin
+    int m_spinCount = 0;
+    // the thread is started and doesn't exit, written under m_mutex
+    std::atomic<bool> m_active{false};
 
     inline void execute();
+    inline bool spin();
+    // returns false if the pool is destroyed or the idle thread of an elastic pool exits
+    inline bool sleep();
+  };
+
+  struct ParallelLoop
+  {
+    int64_t m_begin;
+    int64_t m_end;
+    int64_t m_grain;
+    int m_partCount;
+    Partitioning m_partitioning;
+    std::atomic<int64_t> m_next;
+    std::atomic<int> m_nextPart{0};
+
+    template<typename Function>
+    inline void run(const Function& f);
+    // runs the part of Partitioning::Static or Partitioning::Deterministic
+    template<typename Function>
+    inline void runPart(const Function& f, int part);
+  };
+
+  // jobs being run by the current thread, the outer ones are waiting for something inside of the inner ones
+  struct RunningJob
+  {
+    const Job* m_job;
+    RunningJob* m_parent;
   };
 
-  inline Thread* lockThread(std::unique_lock<std::mutex>& lock);
+  template<typename Condition>
+  inline void waitFor(const Condition& condition, const TaskGroup* group);
+  inline void notifyWaiters();
+#ifdef HELPER_COROUTINES
+  inline bool addGroupAwaiter(TaskGroup* group, std::coroutine_handle<> coroutine);
+  inline void resumeGroupAwaiters();
+#endif
+  inline Thread* currentPoolThread() const;
+  inline void setupThreads(const Options& options);
+  inline void pushJob(Job&& job, TaskGroup* group, int node = -1);
+  inline void pushJobs(Job* jobs, size_t count, TaskGroup* group, int node = -1);
+  inline Thread& nextThread(int node = -1);
+  inline bool takeJob(Job& job, Thread* thread);
+  inline bool takeHighPriorityJob(Job& job);
+  inline bool takeGroupJob(Job& job, Thread* thread, const TaskGroup* group);
+  inline void runJob(Job& job);
+  static inline bool isJobCancelled(const Job& job);
+  inline void wakeThreads();
+  inline void startThread(int index);
+  inline void addThread();
+  static inline void warmUpThread(size_t stackSize);
+  static inline void touchStack(size_t size);
+  inline Priority currentPriority() const;
+  inline int getLoopThreadCount() const;
+  inline TimerId addTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds period, const std::function<void()>& f);
+  inline uint64_t currentTimerTick() const;
+  inline bool hasDueTimers() const;
+  inline void fireTimers();
+#ifdef HELPER_THREADPOOL_STATISTICS
+  inline Counters& currentCounters();
+#endif
+
+  static inline Thread*& currentThread();
+  static inline RunningJob*& runningJobs();
+  static inline FutureStateCache& futureStateCache();
 
 protected:
   Thread* m_threads = nullptr;
-  Thread* m_freeThreads = nullptr;
   int m_threadCount = 0;
-  int m_freeThreadCount = 0;
-  bool m_destroying = false;
+  // the threads running the normal jobs go first, only they are started and stopped by an elastic pool
+  int m_normalThreadCount = 0;
+  int m_minThreadCount = 0;
+  std::chrono::milliseconds m_idleTimeout;
+  std::atomic<int> m_activeThreads{0};
+  int m_batchSize = 0;
+  JobQueue m_queue;
+  // the jobs of Priority::High, the queue is shared by all threads, the jobs which don't fit it go to m_highPriorityJobs
+  JobQueue m_highPriorityQueue;
+  JobDeque m_highPriorityJobs;
+  std::vector<std::vector<int>> m_nodeThreads;
+  std::atomic<unsigned> m_nextThread{0};
+  // all queued jobs, including the ones of Priority::High
+  std::atomic<int> m_queuedJobs{0};
+  std::atomic<int> m_queuedHighPriorityJobs{0};
+  std::atomic<int> m_sleepingThreads{0};
+  std::atomic<int> m_sleepingHighPriorityThreads{0};
+  std::atomic<int> m_waitingThreads{0};
+  // incremented under m_mutex when jobs are added while somebody waits
+  std::atomic<unsigned> m_waiterWakeups{0};
+  TaskGroup m_defaultGroup;
+  // the jobs of the fired timers
+  TaskGroup m_timerGroup;
+  std::atomic<IdlePolicy> m_idlePolicy;
+  int m_spinCount;
+  std::atomic<bool> m_destroying{false};
   CommonThreadFunction m_commonThreadFunction;
   std::mutex m_mutex;
   std::condition_variable m_condition;
+  std::condition_variable m_highPriorityCondition;
+  std::condition_variable m_idleCondition;
+  TimerWheel m_timers;
+  std::mutex m_timerMutex;
+  std::chrono::steady_clock::time_point m_timerStart;
+  std::chrono::nanoseconds m_timerResolution;
+  // copies of the wheel state checked without the lock
+  std::atomic<int> m_timerCount{0};
+  std::atomic<uint64_t> m_nextTimerTick{UINT64_MAX};
+  // a sleeping thread waits for the next timer, guarded by m_mutex
+  bool m_timerWaiter = false;
+#ifdef HELPER_COROUTINES
+  struct GroupAwaiterEntry
+  {
+    TaskGroup* m_group;
+    std::coroutine_handle<> m_coroutine;
+  };
+
+  // coroutines waiting for their groups, guarded by m_mutex
+  std::vector<GroupAwaiterEntry> m_groupAwaiters;
+  std::atomic<int> m_groupAwaiterCount{0};
+#endif
+#ifdef HELPER_THREADPOOL_STATISTICS
+  Counters m_externalCounters;
+  uint64_t m_startTicks;
+  std::chrono::steady_clock::time_point m_startTime;
+#endif
+};
+
+template<typename R>
+class ThreadPool::Future
+{
+public:
+  inline Future();
+  inline Future(Future&& other);
+  inline ~Future();
+
+  inline Future& operator=(Future&& other);
+
+  inline bool isValid() const;
+  inline bool isReady() const;
+  // the waiting thread runs queued pool jobs until the result is ready
+  inline void wait();
+  // waits for the result and moves it out, the future becomes invalid
+  inline R get();
+
+private:
+  friend class ThreadPool;
+
+  inline Future(FutureState* state);
+
+  Future(const Future& other) = delete;
+  Future& operator=(const Future& other) = delete;
+
+  FutureState* m_state;
+};
+
+#ifdef HELPER_COROUTINES
+
+class ThreadPool::ScheduleAwaiter
+{
+public:
+  inline bool await_ready() const;
+  inline void await_suspend(std::coroutine_handle<> coroutine);
+  inline void await_resume() const;
+
+private:
+  friend class ThreadPool;
+
+  inline ScheduleAwaiter(TaskGroup& group);
+
+  TaskGroup& m_group;
+};
+
+class ThreadPool::GroupAwaiter
+{
+public:
+  inline bool await_ready() const;
+  inline bool await_suspend(std::coroutine_handle<> coroutine);
+  inline void await_resume() const;
+
+private:
+  friend class ThreadPool;
+
+  inline GroupAwaiter(TaskGroup& group);
+
+  TaskGroup& m_group;
 };
 
+#endif
+
 // implementation
 
-inline ThreadPool::ThreadPool(int threadCount) : m_threadCount(threadCount)
+inline ThreadPool::ThreadPool(int threadCount) : ThreadPool(Options(threadCount))
+{
+}
+
+inline ThreadPool::ThreadPool(const Options& options) : m_threadCount(options.threadCount),
+  m_idleTimeout(std::max(options.idleTimeout, 0)), m_batchSize(std::max(options.batchSize, 1)),
+  m_queue(options.queueCapacity), m_highPriorityQueue(options.queueCapacity), m_defaultGroup(*this), m_timerGroup(*this), m_idlePolicy(options.idlePolicy), m_spinCount(std::max(options.spinCount, 0)),
+  m_timerStart(std::chrono::steady_clock::now()), m_timerResolution(std::chrono::microseconds(std::max(options.timerResolution, 1)))
 {
   if (m_threadCount < 0)
-    m_threadCount = std::thread::hardware_concurrency();
+  {
+    if (options.affinity == ThreadAffinity::None && options.cpus.empty())
+      m_threadCount = std::thread::hardware_concurrency();
+    else
+      m_threadCount = (int)(options.cpus.empty() ? Platform::Cpu::getCurrentThreadAffinity().size() : options.cpus.size());
+  }
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+  m_externalCounters.m_shared = true;
+  m_startTicks = Platform::Cpu::readTimestampCounter();
+  m_startTime = std::chrono::steady_clock::now();
+#endif
 
   if (m_threadCount > 1)
   {
     m_threads = new Thread[m_threadCount];
+    setupThreads(options);
+
+    m_normalThreadCount = 0;
+    for (; m_normalThreadCount < m_threadCount && !m_threads[m_normalThreadCount].m_highPriority;)
+      m_normalThreadCount++;
+    m_minThreadCount = options.minThreadCount < 0 ? m_normalThreadCount : std::min(options.minThreadCount, m_normalThreadCount);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
     for (int i = 0; i < m_threadCount; i++)
     {
-      m_threads[i].m_threadPool = this;
-      m_threads[i].m_thread = std::thread([this, i]() { m_threads[i].execute(); });
+      if (i < m_minThreadCount || m_threads[i].m_highPriority)
+        startThread(i);
     }
-/*
-    std::unique_lock lock(m_mutex);
-    for (; m_freeThreadCount < m_threadCount;)
-      m_condition.wait(lock);
-*/
   }
 }
 
@@ -82,14 +675,19 @@ inline ThreadPool::~ThreadPool()
   {
     std::unique_lock<std::mutex> lock(m_mutex);
     m_destroying = true;
-    for (Thread* thread = m_freeThreads; thread; thread = thread->m_next)
-      thread->m_condition.notify_one();
+    m_condition.notify_all();
+    m_highPriorityCondition.notify_all();
     lock.unlock();
 
+    // the threads of an elastic pool which have exited are joined too
     for (int i = 0; i < m_threadCount; i++)
-      m_threads[i].m_thread.join();
+    {
+      if (m_threads[i].m_thread.joinable())
+        m_threads[i].m_thread.join();
+    }
 
     delete[] m_threads;
+    m_threads = nullptr;
   }
 }
 
@@ -98,21 +696,107 @@ inline int ThreadPool::getThreadCount() const
   return m_threadCount;
 }
 
-inline void ThreadPool::setCommonThreadFunction(const CommonThreadFunction& f)
+inline int ThreadPool::getActiveThreadCount() const
 {
-  waitJobs();
-  m_commonThreadFunction = f;
+  return m_threads ? m_activeThreads.load() + m_threadCount - m_normalThreadCount : 0;
 }
 
-inline ThreadPool::Thread* ThreadPool::lockThread(std::unique_lock<std::mutex>& lock)
+inline void ThreadPool::warmUp(size_t stackSize)
 {
-  for (; !m_freeThreads;)
-    m_condition.wait(lock);
+  if (!m_threads)
+    return;
 
-  Thread* thread = m_freeThreads;
-  m_freeThreads = thread->m_next;
-  m_freeThreadCount--;
-  return thread;
+  // the other threads may be waiting for the job of the calling thread, so they can't be held until it takes a job
+  if (currentPoolThread())
+  {
+    warmUpThread(stackSize);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (int i = 0; i < m_normalThreadCount; i++)
+  {
+    if (!m_threads[i].m_active)
+      startThread(i);
+  }
+  lock.unlock();
+
+  // every thread is held by its job until all the jobs are taken, so no thread takes two of them,
+  // the group is the last one, so its destructor waits for the jobs using the others
+  std::mutex mutex;
+  std::condition_variable condition;
+  int arrived = 0;
+  TaskGroup group(*this);
+  for (int i = 0; i < m_normalThreadCount; i++)
+  {
+    Job job;
+    job.m_function = [this, stackSize, &mutex, &condition, &arrived]()
+    {
+      warmUpThread(stackSize);
+
+      std::unique_lock<std::mutex> lock(mutex);
+      if (++arrived == m_normalThreadCount)
+        condition.notify_all();
+      for (; arrived < m_normalThreadCount;)
+        condition.wait(lock);
+    };
+    pushJob(std::move(job), &group);
+  }
+  wakeThreads();
+
+  // the calling thread doesn't run the jobs, its stack is not the one to warm up
+  std::unique_lock<std::mutex> arrivedLock(mutex);
+  for (; arrived < m_normalThreadCount;)
+    condition.wait(arrivedLock);
+  arrivedLock.unlock();
+  group.wait();
+}
+
+inline ThreadPool::IdlePolicy ThreadPool::getIdlePolicy() const
+{
+  return m_idlePolicy.load(std::memory_order_relaxed);
+}
+
+inline void ThreadPool::setIdlePolicy(IdlePolicy policy)
+{
+  m_idlePolicy.store(policy, std::memory_order_relaxed);
+}
+
+inline int ThreadPool::getQueuedJobCount(Priority priority) const
+{
+  int highPriorityJobs = m_queuedHighPriorityJobs.load(std::memory_order_relaxed);
+  if (priority == Priority::High)
+    return highPriorityJobs;
+  return std::max(m_queuedJobs.load(std::memory_order_relaxed) - highPriorityJobs, 0);
+}
+
+inline ThreadPool::Statistics ThreadPool::getStatistics() const
+{
+  Statistics statistics;
+#ifdef HELPER_THREADPOOL_STATISTICS
+  // the tick length is measured by the time passed since the pool was created
+  uint64_t ticks = Platform::Cpu::readTimestampCounter() - m_startTicks;
+  double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_startTime).count();
+  statistics.nanosecondsPerTick = ticks > 0 ? nanoseconds / ticks : 1.0;
+
+  int threadCount = m_threads ? m_threadCount : 0;
+  statistics.threads.resize(threadCount + 1);
+  for (int i = 0; i < threadCount; i++)
+  {
+    m_threads[i].m_counters.collect(statistics.threads[i], statistics, statistics.nanosecondsPerTick);
+    statistics.contentionCount += m_threads[i].m_jobs.getContentionCount();
+  }
+  m_externalCounters.collect(statistics.threads.back(), statistics, statistics.nanosecondsPerTick);
+  statistics.contentionCount += m_queue.getContentionCount() + m_highPriorityQueue.getContentionCount() +
+    m_highPriorityJobs.getContentionCount();
+#endif
+  return statistics;
+}
+
+inline void ThreadPool::setCommonThreadFunction(const CommonThreadFunction& f)
+{
+  waitJobs();
+  m_commonThreadFunction = f;
 }
 
 inline bool ThreadPool::addJob(const void* threadData)
@@ -127,12 +811,10 @@ inline bool ThreadPool::addJob(const void* threadData)
     return true;
   }
 
-  std::unique_lock<std::mutex> lock(m_mutex);
-  Thread* thread = lockThread(lock);
-
-  thread->m_job = nullptr;
-  thread->m_data = threadData;
-  thread->m_condition.notify_one();
+  Job job;
+  job.m_data = threadData;
+  pushJob(std::move(job), &m_defaultGroup);
+  wakeThreads();
 
   return true;
 }
@@ -150,71 +832,1730 @@ inline bool ThreadPool::addJobs(const void* const* start, const void* const* end
     return true;
   }
 
-  std::unique_lock<std::mutex> lock(m_mutex);
-  for (; start != end; ++start)
+  constexpr size_t chunkSize = 64;
+  Job jobs[chunkSize];
+  for (; start != end;)
   {
-    Thread* thread = lockThread(lock);
-    thread->m_job = nullptr;
-    thread->m_data = *start;
-    thread->m_condition.notify_one();
+    size_t count = std::min<size_t>(end - start, chunkSize);
+    for (size_t i = 0; i < count; i++)
+      jobs[i].m_data = start[i];
+    pushJobs(jobs, count, &m_defaultGroup);
+    start += count;
   }
+  wakeThreads();
 
   return true;
 }
 
 inline bool ThreadPool::addJob(const std::function<void()>& job)
 {
+  return m_defaultGroup.addJob(job);
+}
+
+inline bool ThreadPool::addJob(const std::function<void()>& job, const CancellationToken& token)
+{
+  return m_defaultGroup.addJob(job, token);
+}
+
+inline void ThreadPool::waitJobs()
+{
+  m_defaultGroup.wait();
+}
+
+template<typename F>
+inline ThreadPool::Future<typename std::decay<decltype(std::declval<typename std::decay<F>::type&>()())>::type> ThreadPool::submit(F&& f, int node)
+{
+  typedef typename std::decay<decltype(std::declval<typename std::decay<F>::type&>()())>::type R;
+  static_assert(sizeof(typename std::decay<F>::type) <= jobCapacity, "callable is too large for submit(), capture less or capture by pointer");
+
+  FutureState* state = FutureState::create(this);
+  Future<R> future(state);
+
+  auto function = [state, f = std::forward<F>(f)]() mutable
+  {
+    FutureResult<R>::set(state->m_result, f);
+    state->m_destroyResult = &FutureResult<R>::destroy;
+    state->setReady();
+    state->release();
+  };
+
   if (!m_threads)
   {
-    job();
-    return true;
+    function();
+    return future;
   }
 
-  std::unique_lock<std::mutex> lock(m_mutex);
-  Thread* thread = lockThread(lock);
-
-  thread->m_job = job;
-  thread->m_condition.notify_one();
+  Job job;
+  job.m_function = std::move(function);
+  pushJob(std::move(job), &m_defaultGroup, node);
+  wakeThreads();
 
-  return true;
+  return future;
 }
 
-inline void ThreadPool::waitJobs()
+template<typename Function>
+inline void ThreadPool::parallelFor(int64_t begin, int64_t end, int64_t grain, const Function& f, Partitioning partitioning)
 {
-  if (!m_threads)
+  if (end <= begin)
     return;
 
-  std::unique_lock<std::mutex> lock(m_mutex);
-  for (; m_freeThreadCount < m_threadCount;)
-    m_condition.wait(lock);
+  int64_t range = end - begin;
+  bool deterministic = partitioning == Partitioning::Deterministic;
+  // a deterministic split doesn't depend on the calling thread, so it doesn't count the threads of high priority jobs
+  int threadCount = 1;
+  if (m_threads)
+    threadCount = deterministic ? m_normalThreadCount : getLoopThreadCount() + (currentPoolThread() ? 0 : 1);
+  if (grain <= 0)
+    grain = std::max<int64_t>(range / (8 * threadCount), 1);
+
+  int64_t chunkCount = (range + grain - 1) / grain;
+  int partCount = (int)std::min<int64_t>(threadCount, chunkCount);
+  if (partCount <= 1)
+  {
+    f(begin, end);
+    return;
+  }
+
+  ParallelLoop loop;
+  loop.m_begin = begin;
+  loop.m_end = end;
+  loop.m_grain = grain;
+  loop.m_partCount = partCount;
+  loop.m_partitioning = partitioning;
+  loop.m_next.store(begin, std::memory_order_relaxed);
+
+  // helper jobs which find the range done exit immediately, so the caller never waits for a free thread
+  TaskGroup group(*this, currentPriority());
+  // there are at most as many jobs as the threads, they are constructed in the scratch arena to be moved to the queues
+  int jobCount = partCount - 1;
+  ScratchArena& scratchArena = getJobContext().m_scratchArena;
+  ScratchArena::Marker scratchMarker = scratchArena.getMarker();
+  Job* jobs = scratchArena.allocate<Job>(jobCount);
+  for (int i = 0; i < jobCount; i++)
+  {
+    new (&jobs[i]) Job();
+    if (deterministic)
+    {
+      int part = i + 1;
+      jobs[i].m_function = [&loop, &f, part]() { loop.runPart(f, part); };
+    }
+    else
+      jobs[i].m_function = [&loop, &f]() { loop.run(f); };
+  }
+  pushJobs(jobs, jobCount, &group);
+  for (int i = 0; i < jobCount; i++)
+    jobs[i].~Job();
+  scratchArena.rewind(scratchMarker);
+  wakeThreads();
+
+  // the caller doesn't help with the other parts of a deterministic loop, waiting runs their jobs if the threads are busy
+  if (deterministic)
+    loop.runPart(f, 0);
+  else
+    loop.run(f);
+  group.wait();
 }
 
-inline void ThreadPool::Thread::execute()
+template<typename T, typename Kernel, typename Combine>
+inline T ThreadPool::parallelReduce(int64_t begin, int64_t end, int64_t grain, const T& identity, const Kernel& kernel,
+  const Combine& combine)
 {
-  std::unique_lock<std::mutex> lock(m_threadPool->m_mutex);
-  for (; !m_threadPool->m_destroying;)
+  if (end <= begin)
+    return identity;
+
+  int64_t range = end - begin;
+  // the split doesn't depend on the calling thread
+  int threadCount = m_threads ? m_normalThreadCount + 1 : 1;
+  if (grain <= 0)
+    grain = std::max<int64_t>(range / (8 * threadCount), 1);
+
+  int64_t grainCount = (range + grain - 1) / grain;
+  if (grainCount == 1)
+    return combine(identity, kernel(begin, end));
+
+  // the parts are limited, so a small grain doesn't take a part result per grain
+  int64_t partCount = std::min<int64_t>(grainCount, 8 * threadCount);
+
+  // the part results are padded to cache lines, so the threads storing them don't share lines
+  struct alignas(Platform::Cpu::cacheLineSize) PartResult
   {
-    lock.unlock();
+    T m_value;
+  };
 
-    if (m_job)
-      m_job();
-    else if (m_threadPool->m_commonThreadFunction)
+  ScratchArena& scratchArena = getJobContext().m_scratchArena;
+  ScratchArena::Marker scratchMarker = scratchArena.getMarker();
+  PartResult* results = scratchArena.allocate<PartResult>(partCount, alignof(PartResult));
+
+  parallelFor(0, partCount, 1, [&](int64_t first, int64_t last)
+  {
+    for (int64_t i = first; i < last; i++)
     {
-      assert(m_data);
-      m_threadPool->m_commonThreadFunction(m_data);
+      // the first grainCount % partCount parts get a grain more
+      int64_t firstGrain = i * (grainCount / partCount) + std::min(i, grainCount % partCount);
+      int64_t lastGrain = firstGrain + grainCount / partCount + (i < grainCount % partCount ? 1 : 0);
+      T value = kernel(begin + firstGrain * grain, std::min(end, begin + (firstGrain + 1) * grain));
+      for (int64_t j = firstGrain + 1; j < lastGrain; j++)
+        value = combine(value, kernel(begin + j * grain, std::min(end, begin + (j + 1) * grain)));
+      new (&results[i].m_value) T(std::move(value));
     }
+  });
 
-    lock.lock();
-    m_job = nullptr;
-    m_next = m_threadPool->m_freeThreads;
-    m_threadPool->m_freeThreads = this;
-    m_threadPool->m_freeThreadCount++;
+  // tree combination keeps the rounding error of floating point sums low
+  for (int64_t step = 1; step < partCount; step *= 2)
+  {
+    for (int64_t i = 0; i + step < partCount; i += 2 * step)
+      results[i].m_value = combine(results[i].m_value, results[i + step].m_value);
+  }
+  T result = combine(identity, results[0].m_value);
 
-    if (m_threadPool->m_destroying)
-      break;
+  for (int64_t i = 0; i < partCount; i++)
+    results[i].m_value.~T();
+  scratchArena.rewind(scratchMarker);
+
+  return result;
+}
+
+template<typename Function>
+inline void ThreadPool::parallelFor2D(int x0, int x1, int y0, int y1, int tileWidth, int tileHeight, const Function& f, Partitioning partitioning,
+  size_t itemSize)
+{
+  if (x1 <= x0 || y1 <= y0)
+    return;
+
+  if (itemSize > 0 && (tileWidth <= 0 || tileHeight <= 0))
+  {
+    int tileSize = Platform::Cpu::getCacheTileSize(itemSize);
+    tileWidth = tileWidth > 0 ? tileWidth : tileSize;
+    tileHeight = tileHeight > 0 ? tileHeight : tileSize;
+  }
+
+  tileWidth = tileWidth > 0 ? std::min(tileWidth, x1 - x0) : x1 - x0;
+  tileHeight = tileHeight > 0 ? std::min(tileHeight, y1 - y0) : y1 - y0;
+  int tilesX = (x1 - x0 + tileWidth - 1) / tileWidth;
+  int tilesY = (y1 - y0 + tileHeight - 1) / tileHeight;
+
+  parallelFor(0, (int64_t)tilesX * tilesY, 1, [&](int64_t begin, int64_t end)
+  {
+    for (int64_t tile = begin; tile < end; tile++)
+    {
+      int tx = x0 + (int)(tile % tilesX) * tileWidth;
+      int ty = y0 + (int)(tile / tilesX) * tileHeight;
+      f(tx, std::min(tx + tileWidth, x1), ty, std::min(ty + tileHeight, y1));
+    }
+  }, partitioning);
+}
+
+inline ThreadPool::Thread*& ThreadPool::currentThread()
+{
+  static thread_local Thread* thread = nullptr;
+  return thread;
+}
+
+inline ThreadPool::RunningJob*& ThreadPool::runningJobs()
+{
+  static thread_local RunningJob* jobs = nullptr;
+  return jobs;
+}
+
+#ifdef HELPER_COROUTINES
+inline ThreadPool::ScheduleAwaiter ThreadPool::schedule()
+{
+  return m_defaultGroup.schedule();
+}
+#endif
+
+inline ThreadPool::TimerId ThreadPool::scheduleAfter(std::chrono::nanoseconds delay, const std::function<void()>& f)
+{
+  return addTimer(delay, std::chrono::nanoseconds(0), f);
+}
+
+inline ThreadPool::TimerId ThreadPool::scheduleEvery(std::chrono::nanoseconds period, const std::function<void()>& f)
+{
+  return addTimer(period, period, f);
+}
+
+inline bool ThreadPool::cancelTimer(TimerId id)
+{
+  std::lock_guard<std::mutex> lock(m_timerMutex);
+  if (!m_timers.remove(id))
+    return false;
+
+  m_timerCount.store((int)m_timers.getCount());
+  m_nextTimerTick.store(m_timers.getNextTick());
+  return true;
+}
+
+inline ThreadPool::JobContext& ThreadPool::getJobContext()
+{
+  Thread* thread = currentThread();
+  if (thread)
+    return thread->m_context;
+
+  static thread_local JobContext context;
+  return context;
+}
+
+inline ThreadPool::FutureStateCache& ThreadPool::futureStateCache()
+{
+  static thread_local FutureStateCache cache;
+  return cache;
+}
+
+template<typename Condition>
+inline void ThreadPool::waitFor(const Condition& condition, const TaskGroup* group)
+{
+  // runs queued jobs of the group while the condition is not met, so waiting inside of a pool job doesn't block the thread,
+  // the jobs of other groups are left to the pool threads, so the waiter is not held by a long unrelated job
+  Thread* thread = currentPoolThread();
+  int spins = 0;
+  for (; !condition();)
+  {
+    Job job;
+    if (takeGroupJob(job, thread, group))
+    {
+      runJob(job);
+      continue;
+    }
+
+    // the awaited jobs are often about to finish, so the waiter polls a while before sleeping,
+    // checking the queues for the jobs of the group every few iterations
+    if (spins < m_spinCount && m_idlePolicy.load(std::memory_order_relaxed) != IdlePolicy::Sleep)
+    {
+      for (int i = 0; i < 64 && !condition(); i++)
+        Platform::Cpu::pause();
+      spins += 64;
+      continue;
+    }
+
+    // the waiter is counted before it looks at the queues the last time, so the jobs added after that wake it up,
+    // the jobs of the group may be added by its running jobs
+    m_waitingThreads.fetch_add(1);
+    unsigned wakeups = m_waiterWakeups.load();
+    bool found = takeGroupJob(job, thread, group);
+    if (!found)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      for (; !condition() && m_waiterWakeups.load() == wakeups;)
+        m_idleCondition.wait(lock);
+    }
+    m_waitingThreads.fetch_sub(1);
+
+    if (found)
+      runJob(job);
+  }
+}
+
+inline void ThreadPool::notifyWaiters()
+{
+#ifdef HELPER_COROUTINES
+  // the awaiter is added before its group is checked, so either the awaiter sees the finished group or the counter
+  // is seen here
+  if (m_groupAwaiterCount.load() > 0)
+    resumeGroupAwaiters();
+#endif
+
+  // the waiters check their condition under the mutex after incrementing m_waitingThreads,
+  // so the notification is needed only if somebody waits
+  if (m_waitingThreads.load() == 0)
+    return;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_idleCondition.notify_all();
+}
+
+#ifdef HELPER_COROUTINES
+inline bool ThreadPool::addGroupAwaiter(TaskGroup* group, std::coroutine_handle<> coroutine)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_groupAwaiterCount.fetch_add(1);
+  if (group->m_pendingJobs.load() == 0)
+  {
+    m_groupAwaiterCount.fetch_sub(1);
+    return false;
+  }
+
+  m_groupAwaiters.push_back(GroupAwaiterEntry{group, coroutine});
+  return true;
+}
+
+inline void ThreadPool::resumeGroupAwaiters()
+{
+  // the group of an awaiter is alive until its coroutine is resumed, the coroutine may destroy it right after that
+  std::vector<std::coroutine_handle<>> ready;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < m_groupAwaiters.size();)
+  {
+    if (m_groupAwaiters[i].m_group->m_pendingJobs.load() != 0)
+    {
+      i++;
+      continue;
+    }
+
+    ready.push_back(m_groupAwaiters[i].m_coroutine);
+    m_groupAwaiters[i] = m_groupAwaiters.back();
+    m_groupAwaiters.pop_back();
+    m_groupAwaiterCount.fetch_sub(1);
+  }
+  lock.unlock();
+
+  for (std::coroutine_handle<> coroutine : ready)
+    m_defaultGroup.run([coroutine]() { coroutine.resume(); });
+}
+#endif
+
+inline ThreadPool::Thread* ThreadPool::currentPoolThread() const
+{
+  Thread* thread = currentThread();
+  return thread && thread->m_threadPool == this ? thread : nullptr;
+}
+
+inline void ThreadPool::setupThreads(const Options& options)
+{
+  using Platform::Cpu::LogicalCpu;
+
+  // the last threads are reserved for high priority jobs, at least one thread is left for the normal ones
+  int highPriorityThreads = std::min(std::max(options.highPriorityThreads, 0), m_threadCount - 1);
+  for (int i = 0; i < m_threadCount; i++)
+  {
+    m_threads[i].m_threadPool = this;
+    m_threads[i].m_index = i;
+    m_threads[i].m_highPriority = i >= m_threadCount - highPriorityThreads;
+  }
+
+  // the threads not pinned to cpus are restricted to the given ones
+  if (options.affinity == ThreadAffinity::None)
+  {
+    for (int i = 0; i < m_threadCount; i++)
+      m_threads[i].m_cpus = options.cpus;
+  }
+  else
+  {
+    // allowed cpus grouped by node, the first logical cpus of the cores go before their SMT siblings
+    const Platform::Cpu::CpuTopology& topology = Platform::Cpu::getCpuTopology();
+    std::vector<int> allowed = options.cpus.empty() ? Platform::Cpu::getCurrentThreadAffinity() : options.cpus;
+    std::vector<std::vector<const LogicalCpu*>> nodes(topology.nodeCount);
+    for (int id : allowed)
+    {
+      const LogicalCpu* cpu = topology.getCpu(id);
+      if (cpu)
+        nodes[cpu->node].push_back(cpu);
+    }
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](const std::vector<const LogicalCpu*>& cpus) { return cpus.empty(); }), nodes.end());
+
+    for (std::vector<const LogicalCpu*>& cpus : nodes)
+    {
+      std::vector<std::pair<int, const LogicalCpu*>> ranked;
+      for (const LogicalCpu* cpu : cpus)
+      {
+        int rank = (int)std::count_if(ranked.begin(), ranked.end(), [cpu](const std::pair<int, const LogicalCpu*>& other) { return other.second->core == cpu->core; });
+        ranked.emplace_back(rank, cpu);
+      }
+      std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, const LogicalCpu*>& a, const std::pair<int, const LogicalCpu*>& b) { return a.first < b.first; });
+      for (size_t i = 0; i < cpus.size(); i++)
+        cpus[i] = ranked[i].second;
+    }
+
+    for (int i = 0; !nodes.empty() && i < m_threadCount; i++)
+    {
+      Thread& thread = m_threads[i];
+      const std::vector<const LogicalCpu*>& cpus = nodes[i % nodes.size()];
+      if (options.affinity == ThreadAffinity::Core)
+        thread.m_cpus.push_back(cpus[(i / nodes.size()) % cpus.size()]->id);
+      else
+      {
+        for (const LogicalCpu* cpu : cpus)
+          thread.m_cpus.push_back(cpu->id);
+      }
+      thread.m_node = cpus.front()->node;
+      if (thread.m_highPriority)
+        continue;
+
+      if (thread.m_node >= (int)m_nodeThreads.size())
+        m_nodeThreads.resize(thread.m_node + 1);
+      m_nodeThreads[thread.m_node].push_back(i);
+    }
+  }
+
+  for (int i = 0; i < m_threadCount; i++)
+  {
+    Thread& thread = m_threads[i];
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (int j = 1; j < m_threadCount; j++)
+      {
+        int victim = (i + j) % m_threadCount;
+        if ((m_threads[victim].m_node == thread.m_node) == (pass == 0))
+          thread.m_victims.push_back(victim);
+      }
+    }
+  }
+}
+
+inline void ThreadPool::pushJob(Job&& job, TaskGroup* group, int node)
+{
+  pushJobs(&job, 1, group, node);
+}
+
+inline void ThreadPool::pushJobs(Job* jobs, size_t count, TaskGroup* group, int node)
+{
+#ifdef HELPER_THREADPOOL_STATISTICS
+  uint64_t ticks = Platform::Cpu::readTimestampCounter();
+  for (size_t i = 0; i < count; i++)
+    jobs[i].m_queuedTicks = ticks;
+#endif
+  for (size_t i = 0; i < count; i++)
+    jobs[i].m_group = group;
+  group->m_pendingJobs.fetch_add((int)count);
+
+  if (group->m_priority == Priority::High)
+  {
+    size_t pushed = 0;
+    for (size_t n; pushed < count && (n = m_highPriorityQueue.push(jobs + pushed, count - pushed)) > 0;)
+      pushed += n;
+    if (pushed < count)
+      m_highPriorityJobs.push(jobs + pushed, count - pushed);
+
+    // m_queuedJobs is the second, so a thread seeing it finds the job in either counter
+    m_queuedHighPriorityJobs.fetch_add((int)count);
+    m_queuedJobs.fetch_add((int)count);
+    return;
+  }
+
+  // jobs added from a pool thread go to its own queue, others go to the shared queue,
+  // when it is full the rest are spread over the thread queues,
+  // jobs with a node hint go to the queues of the threads of that node,
+  // the threads reserved for high priority jobs don't keep the normal ones
+  Thread* thread = currentPoolThread();
+  if (thread && thread->m_highPriority)
+    thread = nullptr;
+  if (node >= 0 && node < (int)m_nodeThreads.size() && !m_nodeThreads[node].empty() && (!thread || thread->m_node != node))
+  {
+    for (size_t i = 0; i < count; i++)
+      nextThread(node).m_jobs.push(std::move(jobs[i]));
+  }
+  else if (thread)
+    thread->m_jobs.push(jobs, count);
+  else
+  {
+    size_t pushed = 0;
+    for (size_t n; pushed < count && (n = m_queue.push(jobs + pushed, count - pushed)) > 0;)
+      pushed += n;
+
+    for (; pushed < count; pushed++)
+      nextThread().m_jobs.push(std::move(jobs[pushed]));
+  }
+
+  m_queuedJobs.fetch_add((int)count);
+}
+
+inline ThreadPool::Thread& ThreadPool::nextThread(int node)
+{
+  // the jobs spread over the thread queues go to the running threads taking the normal jobs, of the node if it is given,
+  // a job put to the queue of a thread stopped by an elastic pool meanwhile is stolen by the others
+  const std::vector<int>* threads = node >= 0 ? &m_nodeThreads[node] : nullptr;
+  unsigned count = threads ? (unsigned)threads->size() : (unsigned)m_normalThreadCount;
+  unsigned next = m_nextThread.fetch_add(1, std::memory_order_relaxed);
+  for (unsigned i = 0; i < count; i++)
+  {
+    Thread& thread = m_threads[threads ? (*threads)[(next + i) % count] : (next + i) % count];
+    if (thread.m_active.load(std::memory_order_relaxed))
+      return thread;
+  }
+
+  return m_threads[threads ? (*threads)[next % count] : next % count];
+}
+
+inline bool ThreadPool::takeHighPriorityJob(Job& job)
+{
+  if (m_queuedHighPriorityJobs.load(std::memory_order_relaxed) == 0)
+    return false;
+
+  if (!m_highPriorityQueue.pop(&job, 1) && !m_highPriorityJobs.steal(job))
+    return false;
+
+  m_queuedHighPriorityJobs.fetch_sub(1);
+  m_queuedJobs.fetch_sub(1);
+  return true;
+}
+
+inline bool ThreadPool::takeJob(Job& job, Thread* thread)
+{
+  // high priority jobs are taken first, so they wait for the running jobs only
+  if (takeHighPriorityJob(job))
+    return true;
+  if (thread && thread->m_highPriority)
+    return false;
+
+  if (thread)
+  {
+    if (thread->m_jobs.pop(job))
+    {
+      m_queuedJobs.fetch_sub(1);
+      return true;
+    }
+
+    // take a batch from the shared queue, the jobs not run immediately may be stolen by other threads
+    Job* batch = thread->m_batch.data();
+    size_t count = m_queue.pop(batch, thread->m_batch.size());
+    if (count > 0)
+    {
+      job = std::move(batch[0]);
+      thread->m_jobs.push(batch + 1, count - 1);
+      m_queuedJobs.fetch_sub(1);
+      if (count > 1)
+        wakeThreads();
+      return true;
+    }
+  }
+  else if (m_queue.pop(&job, 1))
+  {
+    m_queuedJobs.fetch_sub(1);
+    return true;
+  }
+
+  if (thread)
+  {
+    for (int victim : thread->m_victims)
+    {
+      if (m_threads[victim].m_jobs.steal(job))
+      {
+        m_queuedJobs.fetch_sub(1);
+#ifdef HELPER_THREADPOOL_STATISTICS
+        thread->m_counters.add(thread->m_counters.m_stealCount, 1);
+#endif
+        return true;
+      }
+    }
+    return false;
+  }
+
+  for (int i = 0; i < m_threadCount; i++)
+  {
+    if (m_threads[i].m_jobs.steal(job))
+    {
+      m_queuedJobs.fetch_sub(1);
+#ifdef HELPER_THREADPOOL_STATISTICS
+      m_externalCounters.add(m_externalCounters.m_stealCount, 1);
+#endif
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline bool ThreadPool::takeGroupJob(Job& job, Thread* thread, const TaskGroup* group)
+{
+  if (group->m_priority == Priority::High)
+  {
+    // the jobs of other groups taken from the shared queue are moved to the overflow queue, which is checked too
+    bool found = m_highPriorityJobs.steal(job, group);
+    for (int i = 0; !found && i < m_batchSize && m_highPriorityQueue.pop(&job, 1); i++)
+    {
+      found = job.m_group == group;
+      if (!found)
+        m_highPriorityJobs.push(std::move(job));
+    }
+    if (!found)
+      return false;
+
+    m_queuedHighPriorityJobs.fetch_sub(1);
+    m_queuedJobs.fetch_sub(1);
+    return true;
+  }
+
+  if (thread && thread->m_highPriority)
+    thread = nullptr;
+
+  if (thread && thread->m_jobs.steal(job, group))
+  {
+    m_queuedJobs.fetch_sub(1);
+    return true;
+  }
+
+  // the shared queue is FIFO only, the jobs of other groups taken from it are moved to the thread queues
+  bool moved = false;
+  for (int i = 0; i < m_batchSize && m_queue.pop(&job, 1); i++)
+  {
+    if (job.m_group == group)
+    {
+      m_queuedJobs.fetch_sub(1);
+      if (moved)
+        wakeThreads();
+      return true;
+    }
+
+    Thread& target = thread ? *thread : nextThread();
+    target.m_jobs.push(std::move(job));
+    moved = true;
+  }
+  if (moved)
+    wakeThreads();
+
+  for (int i = 0; i < m_threadCount; i++)
+  {
+    Thread& victim = thread ? m_threads[thread->m_victims[i % thread->m_victims.size()]] : m_threads[i];
+    if (victim.m_jobs.steal(job, group))
+    {
+      m_queuedJobs.fetch_sub(1);
+#ifdef HELPER_THREADPOOL_STATISTICS
+      Counters& counters = thread ? thread->m_counters : m_externalCounters;
+      counters.add(counters.m_stealCount, 1);
+#endif
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline void ThreadPool::runJob(Job& job)
+{
+  RunningJob*& jobs = runningJobs();
+  RunningJob running = {&job, jobs};
+  jobs = &running;
+
+  // the job may be run by a thread helping while waiting inside of another job, so only the scratch memory
+  // of this job is freed
+  ScratchArena& scratchArena = getJobContext().m_scratchArena;
+  ScratchArena::Marker scratchMarker = scratchArena.getMarker();
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+  Counters& counters = currentCounters();
+  uint64_t startTicks = Platform::Cpu::readTimestampCounter();
+  // the counters of different cores may differ a bit
+  counters.addDuration(counters.m_queueDelay, startTicks > job.m_queuedTicks ? startTicks - job.m_queuedTicks : 0);
+#endif
+
+  if (!isJobCancelled(job))
+  {
+    Trace::Scope traceScope("ThreadPool job");
+    if (job.m_function)
+      job.m_function();
+    else
+    {
+      assert(m_commonThreadFunction);
+      m_commonThreadFunction(job.m_data);
+    }
+  }
+  job.m_function = nullptr;
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+  uint64_t ticks = Platform::Cpu::readTimestampCounter() - startTicks;
+  counters.addDuration(counters.m_runTime, ticks);
+  counters.add(counters.m_jobCount, 1);
+  // the jobs run while waiting inside of another job are a part of its time
+  if (!running.m_parent)
+    counters.add(counters.m_busyTicks, ticks);
+#endif
+
+  scratchArena.rewind(scratchMarker);
+  jobs = running.m_parent;
+
+  // the group may be destroyed by its waiter as soon as the counter is zero
+  if (job.m_group->m_pendingJobs.fetch_sub(1) == 1)
+    notifyWaiters();
+}
+
+inline void ThreadPool::startThread(int index)
+{
+  // the thread of the slot may have exited after the idle timeout
+  Thread& thread = m_threads[index];
+  if (thread.m_thread.joinable())
+    thread.m_thread.join();
+
+  thread.m_active = true;
+  if (!thread.m_highPriority)
+    m_activeThreads.fetch_add(1);
+  thread.m_thread = std::thread([this, index]() { m_threads[index].execute(); });
+}
+
+inline void ThreadPool::addThread()
+{
+  // a thread is added when the normal jobs queued are at least as many as the running threads, m_mutex is locked
+  // by the caller, the sleeping threads are woken up instead
+  int active = m_activeThreads.load();
+  if (m_destroying || active >= m_normalThreadCount || m_sleepingThreads.load() > 0)
+    return;
+
+  int queued = m_queuedJobs.load() - m_queuedHighPriorityJobs.load();
+  if (queued <= 0 || queued < active)
+    return;
+
+  for (int i = 0; i < m_normalThreadCount; i++)
+  {
+    if (!m_threads[i].m_active)
+    {
+      startThread(i);
+      return;
+    }
+  }
+}
+
+inline void ThreadPool::warmUpThread(size_t stackSize)
+{
+  touchStack(stackSize);
+  ScratchArena& scratchArena = getJobContext().getScratchArena();
+  size_t scratchSize = scratchArena.getCapacity() > 0 ? scratchArena.getCapacity() : 64 * 1024;
+  memset(scratchArena.allocateBytes(scratchSize / 2), 0, scratchSize / 2);
+}
+
+inline void ThreadPool::touchStack(size_t size)
+{
+  // the page is written after the nested call, so the call is not a tail call and the frames stay on the stack
+  volatile unsigned char page[4096];
+  page[0] = 1;
+  if (size > sizeof(page))
+    touchStack(size - sizeof(page));
+  page[sizeof(page) - 1] = page[0];
+}
+
+inline bool ThreadPool::isJobCancelled(const Job& job)
+{
+  return job.m_cancellable && (job.m_cancellationToken.isCancelled() || job.m_group->isCancelled());
+}
+
+inline void ThreadPool::wakeThreads()
+{
+  // the sleeping waiters look for the jobs of their groups again
+  if (m_waitingThreads.load() > 0)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_waiterWakeups.fetch_add(1);
+    m_idleCondition.notify_all();
+  }
+
+  // sleeping threads recheck m_queuedJobs under m_mutex, so the notification is needed only if somebody sleeps
+  int sleeping = m_sleepingThreads.load();
+  int sleepingHighPriority = m_queuedHighPriorityJobs.load() > 0 ? m_sleepingHighPriorityThreads.load() : 0;
+  if (sleeping == 0 && sleepingHighPriority == 0)
+  {
+    // an elastic pool starts a thread if the running ones are not enough for the jobs
+    int active = m_activeThreads.load(std::memory_order_relaxed);
+    if (active < m_normalThreadCount && m_queuedJobs.load(std::memory_order_relaxed) >= active)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      addThread();
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (sleepingHighPriority > 0)
+    m_highPriorityCondition.notify_all();
+  if (sleeping == 0)
+    return;
+  // the sleeping threads of an elastic pool may have exited meanwhile
+  if (m_sleepingThreads.load() == 0)
+  {
+    addThread();
+    return;
+  }
+  if (m_queuedJobs.load() > 1 && sleeping > 1)
+    m_condition.notify_all();
+  else
+    m_condition.notify_one();
+}
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+inline ThreadPool::Counters& ThreadPool::currentCounters()
+{
+  Thread* thread = currentPoolThread();
+  return thread ? thread->m_counters : m_externalCounters;
+}
+#endif
+
+inline ThreadPool::TimerId ThreadPool::addTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds period,
+  const std::function<void()>& f)
+{
+  assert(m_threads);
+  if (!m_threads)
+    return 0;
+
+  // the timer doesn't fire earlier than the delay, so its tick is rounded up
+  std::chrono::nanoseconds expiry = std::chrono::steady_clock::now() - m_timerStart + std::max(delay, std::chrono::nanoseconds(0));
+  uint64_t tick = (uint64_t)((expiry + m_timerResolution - std::chrono::nanoseconds(1)) / m_timerResolution);
+  uint64_t periodTicks = period.count() > 0 ? std::max<uint64_t>((uint64_t)(period / m_timerResolution), 1) : 0;
+
+  std::unique_lock<std::mutex> lock(m_timerMutex);
+  TimerId id = m_timers.add(tick, periodTicks, std::make_shared<const TimerWheel::Function>(f));
+  uint64_t nextTick = m_timers.getNextTick();
+  bool earlier = nextTick < m_nextTimerTick.load();
+  m_timerCount.store((int)m_timers.getCount());
+  m_nextTimerTick.store(nextTick);
+  lock.unlock();
+
+  // the thread waiting for the previous next timer waits for this one instead, an elastic pool without threads
+  // starts one for the timers
+  if (earlier)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_activeThreads.load() == 0 && m_normalThreadCount > 0 && !m_destroying)
+      startThread(0);
+    m_condition.notify_all();
+  }
+  return id;
+}
+
+inline uint64_t ThreadPool::currentTimerTick() const
+{
+  return (uint64_t)((std::chrono::steady_clock::now() - m_timerStart) / m_timerResolution);
+}
+
+inline bool ThreadPool::hasDueTimers() const
+{
+  return m_timerCount.load(std::memory_order_relaxed) > 0 && currentTimerTick() >= m_nextTimerTick.load(std::memory_order_relaxed);
+}
+
+inline void ThreadPool::fireTimers()
+{
+  if (!hasDueTimers())
+    return;
+
+  // a single thread fires the timers, the others go on with the jobs
+  std::unique_lock<std::mutex> lock(m_timerMutex, std::try_to_lock);
+  if (!lock.owns_lock())
+    return;
+
+  bool fired = false;
+  m_timers.advance(currentTimerTick(), [this, &fired](const std::shared_ptr<const TimerWheel::Function>& function)
+  {
+    Job job;
+    job.m_function = [function]() { (*function)(); };
+    pushJob(std::move(job), &m_timerGroup);
+    fired = true;
+  });
+  m_timerCount.store((int)m_timers.getCount());
+  m_nextTimerTick.store(m_timers.getNextTick());
+  lock.unlock();
+
+  if (fired)
+    wakeThreads();
+}
+
+inline ThreadPool::Priority ThreadPool::currentPriority() const
+{
+  RunningJob* running = runningJobs();
+  return running && running->m_job->m_group->m_priority == Priority::High ? Priority::High : Priority::Normal;
+}
+
+inline int ThreadPool::getLoopThreadCount() const
+{
+  // the threads reserved for high priority jobs run the parts of the loops of high priority jobs only,
+  // an elastic pool starts its stopped threads for the queued parts
+  return currentPriority() == Priority::High ? m_threadCount : m_normalThreadCount;
+}
+
+// ThreadPool::ParallelLoop
+
+template<typename Function>
+inline void ThreadPool::ParallelLoop::run(const Function& f)
+{
+  switch (m_partitioning)
+  {
+  case Partitioning::Static:
+    for (int part; (part = m_nextPart.fetch_add(1, std::memory_order_relaxed)) < m_partCount;)
+      runPart(f, part);
+    break;
+
+  case Partitioning::Deterministic:
+    // the parts are given to the jobs by parallelFor()
+    assert(false);
+    break;
+
+  case Partitioning::Dynamic:
+    for (int64_t first; (first = m_next.fetch_add(m_grain, std::memory_order_relaxed)) < m_end;)
+      f(first, std::min(first + m_grain, m_end));
+    break;
+
+  case Partitioning::Guided:
+    for (int64_t first = m_next.load(std::memory_order_relaxed); first < m_end;)
+    {
+      int64_t size = std::max((m_end - first) / (2 * m_partCount), m_grain);
+      size = (size + m_grain - 1) / m_grain * m_grain;
+      int64_t last = std::min(first + size, m_end);
+      if (m_next.compare_exchange_weak(first, last, std::memory_order_relaxed))
+      {
+        f(first, last);
+        first = m_next.load(std::memory_order_relaxed);
+      }
+    }
+    break;
+  }
+}
+
+template<typename Function>
+inline void ThreadPool::ParallelLoop::runPart(const Function& f, int part)
+{
+  int64_t chunkCount = (m_end - m_begin + m_grain - 1) / m_grain;
+  int64_t first = m_begin + chunkCount * part / m_partCount * m_grain;
+  int64_t last = m_begin + chunkCount * (part + 1) / m_partCount * m_grain;
+  f(first, std::min(last, m_end));
+}
+
+// ThreadPool::FutureState
+
+inline ThreadPool::FutureState* ThreadPool::FutureState::create(ThreadPool* threadPool)
+{
+  FutureStateCache& cache = futureStateCache();
+  FutureState* state = cache.m_states;
+  if (state)
+  {
+    cache.m_states = state->m_next;
+    cache.m_count--;
+  }
+  else
+    state = new FutureState;
+
+  state->m_references.store(2, std::memory_order_relaxed);
+  state->m_ready.store(false, std::memory_order_relaxed);
+  state->m_threadPool = threadPool;
+  state->m_destroyResult = nullptr;
+  state->m_next = nullptr;
+  return state;
+}
+
+inline void ThreadPool::FutureState::setReady()
+{
+  m_ready.store(true);
+  m_threadPool->notifyWaiters();
+}
+
+inline void ThreadPool::FutureState::release()
+{
+  if (m_references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  if (m_destroyResult)
+    m_destroyResult(m_result);
+
+  // the cache keeps enough states for the typical number of futures alive at once
+  FutureStateCache& cache = futureStateCache();
+  if (cache.m_count >= 1024)
+  {
+    delete this;
+    return;
+  }
+
+  m_next = cache.m_states;
+  cache.m_states = this;
+  cache.m_count++;
+}
+
+inline ThreadPool::FutureStateCache::~FutureStateCache()
+{
+  for (; m_states;)
+  {
+    FutureState* next = m_states->m_next;
+    delete m_states;
+    m_states = next;
+  }
+}
+
+template<typename R>
+struct ThreadPool::FutureResult
+{
+  static_assert(sizeof(R) <= futureResultCapacity && alignof(R) <= alignof(std::max_align_t), "result is too large for submit()");
+
+  template<typename F>
+  static inline void set(void* result, F& f)
+  {
+    new (result) R(f());
+  }
+
+  static inline void destroy(void* result)
+  {
+    ((R*)result)->~R();
+  }
+
+  static inline R take(FutureState* state)
+  {
+    R result = std::move(*(R*)state->m_result);
+    state->release();
+    return result;
+  }
+};
+
+template<>
+struct ThreadPool::FutureResult<void>
+{
+  template<typename F>
+  static inline void set(void*, F& f)
+  {
+    f();
+  }
+
+  static inline void destroy(void*)
+  {
+  }
+
+  static inline void take(FutureState* state)
+  {
+    state->release();
+  }
+};
+
+// ThreadPool::Future<R>
+
+template<typename R>
+inline ThreadPool::Future<R>::Future() : m_state(nullptr)
+{
+}
+
+template<typename R>
+inline ThreadPool::Future<R>::Future(FutureState* state) : m_state(state)
+{
+}
+
+template<typename R>
+inline ThreadPool::Future<R>::Future(Future&& other) : m_state(other.m_state)
+{
+  other.m_state = nullptr;
+}
+
+template<typename R>
+inline ThreadPool::Future<R>::~Future()
+{
+  if (m_state)
+    m_state->release();
+}
+
+template<typename R>
+inline ThreadPool::Future<R>& ThreadPool::Future<R>::operator=(Future&& other)
+{
+  if (this != &other)
+  {
+    if (m_state)
+      m_state->release();
+    m_state = other.m_state;
+    other.m_state = nullptr;
+  }
+  return *this;
+}
+
+template<typename R>
+inline bool ThreadPool::Future<R>::isValid() const
+{
+  return m_state != nullptr;
+}
+
+template<typename R>
+inline bool ThreadPool::Future<R>::isReady() const
+{
+  assert(m_state);
+  return m_state->m_ready.load(std::memory_order_acquire);
+}
+
+template<typename R>
+inline void ThreadPool::Future<R>::wait()
+{
+  assert(m_state);
+  FutureState* state = m_state;
+  state->m_threadPool->waitFor([state]() { return state->m_ready.load(); }, &state->m_threadPool->m_defaultGroup);
+}
+
+template<typename R>
+inline R ThreadPool::Future<R>::get()
+{
+  wait();
+  FutureState* state = m_state;
+  m_state = nullptr;
+  return FutureResult<R>::take(state);
+}
+
+// ThreadPool::JobContext
+
+inline int ThreadPool::JobContext::getThreadIndex() const
+{
+  return m_threadIndex;
+}
+
+inline int ThreadPool::JobContext::getNode() const
+{
+  return m_node;
+}
+
+inline ScratchArena& ThreadPool::JobContext::getScratchArena()
+{
+  return m_scratchArena;
+}
+
+inline bool ThreadPool::JobContext::isCancelled() const
+{
+  RunningJob* running = runningJobs();
+  return running && isJobCancelled(*running->m_job);
+}
+
+// ThreadPool::TaskGroup
+
+inline ThreadPool::TaskGroup::TaskGroup(ThreadPool& threadPool, Priority priority) : m_threadPool(threadPool), m_priority(priority)
+{
+}
+
+inline ThreadPool::TaskGroup::~TaskGroup()
+{
+  wait();
+}
+
+inline ThreadPool& ThreadPool::TaskGroup::getThreadPool() const
+{
+  return m_threadPool;
+}
+
+inline ThreadPool::Priority ThreadPool::TaskGroup::getPriority() const
+{
+  return m_priority;
+}
+
+inline int ThreadPool::TaskGroup::getPendingJobCount() const
+{
+  return m_pendingJobs.load();
+}
+
+inline bool ThreadPool::TaskGroup::addJob(const std::function<void()>& job, int node)
+{
+  return addJob(job, CancellationToken(), node);
+}
+
+inline bool ThreadPool::TaskGroup::addJob(const std::function<void()>& job, const CancellationToken& token, int node)
+{
+  if (!m_threadPool.m_threads)
+  {
+    if (!token.isCancelled() && !isCancelled())
+      job();
+    return true;
+  }
+
+  Job poolJob;
+  poolJob.m_function = job;
+  poolJob.m_cancellationToken = token;
+  m_threadPool.pushJob(std::move(poolJob), this, node);
+  m_threadPool.wakeThreads();
+
+  return true;
+}
+
+template<typename F>
+inline void ThreadPool::TaskGroup::run(F&& f, int node)
+{
+  run(std::forward<F>(f), CancellationToken(), node);
+}
+
+template<typename F>
+inline void ThreadPool::TaskGroup::run(F&& f, const CancellationToken& token, int node)
+{
+  if (!m_threadPool.m_threads)
+  {
+    if (!token.isCancelled() && !isCancelled())
+      f();
+    return;
+  }
+
+  Job job;
+  job.m_function = std::forward<F>(f);
+  job.m_cancellationToken = token;
+  m_threadPool.pushJob(std::move(job), this, node);
+  m_threadPool.wakeThreads();
+}
+
+inline void ThreadPool::TaskGroup::wait()
+{
+  if (!m_threadPool.m_threads)
+    return;
+
+  // a job waiting for its own group would wait for itself forever
+  int ownJobs = 0;
+  for (RunningJob* running = runningJobs(); running; running = running->m_parent)
+  {
+    if (running->m_job->m_group == this)
+      ownJobs++;
+  }
+
+  m_threadPool.waitFor([this, ownJobs]() { return m_pendingJobs.load() <= ownJobs; }, this);
+}
+
+inline void ThreadPool::TaskGroup::cancel()
+{
+  m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+inline bool ThreadPool::TaskGroup::isCancelled() const
+{
+  return m_cancelled.load(std::memory_order_relaxed) || m_cancellationToken.isCancelled();
+}
+
+inline void ThreadPool::TaskGroup::setCancellationToken(const CancellationToken& token)
+{
+  assert(m_pendingJobs.load() == 0);
+  m_cancellationToken = token;
+}
+
+inline const CancellationToken& ThreadPool::TaskGroup::getCancellationToken() const
+{
+  return m_cancellationToken;
+}
+
+#ifdef HELPER_COROUTINES
+inline ThreadPool::ScheduleAwaiter ThreadPool::TaskGroup::schedule()
+{
+  return ScheduleAwaiter(*this);
+}
+
+inline ThreadPool::GroupAwaiter ThreadPool::TaskGroup::operator co_await()
+{
+  return GroupAwaiter(*this);
+}
+
+// ThreadPool::ScheduleAwaiter
+
+inline ThreadPool::ScheduleAwaiter::ScheduleAwaiter(TaskGroup& group) : m_group(group)
+{
+}
+
+inline bool ThreadPool::ScheduleAwaiter::await_ready() const
+{
+  // a pool without threads runs the jobs by the calling thread
+  return !m_group.m_threadPool.m_threads;
+}
+
+inline void ThreadPool::ScheduleAwaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+  Job job;
+  job.m_function = [coroutine]() { coroutine.resume(); };
+  job.m_cancellable = false;
+  m_group.m_threadPool.pushJob(std::move(job), &m_group);
+  m_group.m_threadPool.wakeThreads();
+}
+
+inline void ThreadPool::ScheduleAwaiter::await_resume() const
+{
+}
+
+// ThreadPool::GroupAwaiter
+
+inline ThreadPool::GroupAwaiter::GroupAwaiter(TaskGroup& group) : m_group(group)
+{
+}
+
+inline bool ThreadPool::GroupAwaiter::await_ready() const
+{
+  return m_group.m_pendingJobs.load() == 0;
+}
+
+inline bool ThreadPool::GroupAwaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+  return m_group.m_threadPool.addGroupAwaiter(&m_group, coroutine);
+}
+
+inline void ThreadPool::GroupAwaiter::await_resume() const
+{
+}
+#endif
+
+// ThreadPool::JobDeque
+
+inline void ThreadPool::JobDeque::reserve()
+{
+  std::unique_lock<std::mutex> lock = this->lock();
+  if (m_jobs.empty())
+    grow();
+}
+
+inline void ThreadPool::JobDeque::push(Job&& job)
+{
+  std::unique_lock<std::mutex> lock = this->lock();
+  if (m_tail - m_head == m_jobs.size())
+    grow();
+
+  m_jobs[m_tail & (m_jobs.size() - 1)] = std::move(job);
+  m_tail++;
+}
+
+inline void ThreadPool::JobDeque::push(Job* jobs, size_t count)
+{
+  if (count == 0)
+    return;
+
+  std::unique_lock<std::mutex> lock = this->lock();
+  for (; m_tail - m_head + count > m_jobs.size();)
+    grow();
+
+  for (size_t i = 0; i < count; i++)
+    m_jobs[(m_tail + i) & (m_jobs.size() - 1)] = std::move(jobs[i]);
+  m_tail += count;
+}
+
+inline bool ThreadPool::JobDeque::pop(Job& job)
+{
+  std::unique_lock<std::mutex> lock = this->lock();
+  if (m_head == m_tail)
+    return false;
+
+  m_tail--;
+  job = std::move(m_jobs[m_tail & (m_jobs.size() - 1)]);
+  return true;
+}
+
+inline bool ThreadPool::JobDeque::steal(Job& job)
+{
+  std::unique_lock<std::mutex> lock = this->lock();
+  if (m_head == m_tail)
+    return false;
+
+  job = std::move(m_jobs[m_head & (m_jobs.size() - 1)]);
+  m_head++;
+  return true;
+}
+
+inline bool ThreadPool::JobDeque::steal(Job& job, const TaskGroup* group)
+{
+  // the oldest job of the group is taken, the oldest job of the queue fills its place
+  std::unique_lock<std::mutex> lock = this->lock();
+  size_t mask = m_jobs.size() - 1;
+  for (size_t i = m_head; i != m_tail; i++)
+  {
+    Job& found = m_jobs[i & mask];
+    if (found.m_group == group)
+    {
+      job = std::move(found);
+      if (i != m_head)
+        found = std::move(m_jobs[m_head & mask]);
+      m_head++;
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+inline uint64_t ThreadPool::JobDeque::getContentionCount() const
+{
+  return m_contentionCount.load(std::memory_order_relaxed);
+}
+#endif
+
+inline std::unique_lock<std::mutex> ThreadPool::JobDeque::lock()
+{
+#ifdef HELPER_THREADPOOL_STATISTICS
+  std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+  if (!lock.owns_lock())
+  {
+    m_contentionCount.fetch_add(1, std::memory_order_relaxed);
+    lock.lock();
+  }
+  return lock;
+#else
+  return std::unique_lock<std::mutex>(m_mutex);
+#endif
+}
+
+inline void ThreadPool::JobDeque::grow()
+{
+  // the ring buffer only grows, so the steady state does not allocate
+  std::vector<Job> jobs(m_jobs.empty() ? 64 : m_jobs.size() * 2);
+  size_t count = m_tail - m_head;
+  for (size_t i = 0; i < count; i++)
+    jobs[i] = std::move(m_jobs[(m_head + i) & (m_jobs.size() - 1)]);
+
+  m_jobs.swap(jobs);
+  m_head = 0;
+  m_tail = count;
+}
+
+// ThreadPool::JobQueue
+
+inline ThreadPool::JobQueue::JobQueue(size_t capacity)
+{
+  size_t size = 2;
+  for (; size < capacity;)
+    size *= 2;
+
+  m_cells = new Cell[size];
+  m_mask = size - 1;
+  for (size_t i = 0; i < size; i++)
+    m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+}
+
+inline ThreadPool::JobQueue::~JobQueue()
+{
+  delete[] m_cells;
+}
+
+inline size_t ThreadPool::JobQueue::push(Job* jobs, size_t count)
+{
+  // claims up to count consecutive free cells with a single CAS
+  size_t position = m_pushPosition.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    size_t n = 0;
+    for (; n < count && m_cells[(position + n) & m_mask].m_sequence.load(std::memory_order_acquire) == position + n;)
+      n++;
+
+    if (n == 0)
+    {
+      intptr_t diff = (intptr_t)m_cells[position & m_mask].m_sequence.load(std::memory_order_acquire) - (intptr_t)position;
+      if (diff < 0)
+        return 0; // full
+
+      position = m_pushPosition.load(std::memory_order_relaxed);
+      continue;
+    }
+
+    if (m_pushPosition.compare_exchange_weak(position, position + n, std::memory_order_relaxed))
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        Cell& cell = m_cells[(position + i) & m_mask];
+        cell.m_job = std::move(jobs[i]);
+        cell.m_sequence.store(position + i + 1, std::memory_order_release);
+      }
+      return n;
+    }
+#ifdef HELPER_THREADPOOL_STATISTICS
+    m_contentionCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+  }
+}
+
+inline size_t ThreadPool::JobQueue::pop(Job* jobs, size_t count)
+{
+  // claims up to count consecutive ready cells with a single CAS
+  size_t position = m_popPosition.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    size_t n = 0;
+    for (; n < count && m_cells[(position + n) & m_mask].m_sequence.load(std::memory_order_acquire) == position + n + 1;)
+      n++;
+
+    if (n == 0)
+    {
+      intptr_t diff = (intptr_t)m_cells[position & m_mask].m_sequence.load(std::memory_order_acquire) - (intptr_t)(position + 1);
+      if (diff < 0)
+        return 0; // empty
+
+      position = m_popPosition.load(std::memory_order_relaxed);
+      continue;
+    }
+
+    if (m_popPosition.compare_exchange_weak(position, position + n, std::memory_order_relaxed))
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        Cell& cell = m_cells[(position + i) & m_mask];
+        jobs[i] = std::move(cell.m_job);
+        cell.m_sequence.store(position + i + m_mask + 1, std::memory_order_release);
+      }
+      return n;
+    }
+#ifdef HELPER_THREADPOOL_STATISTICS
+    m_contentionCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+  }
+}
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+inline uint64_t ThreadPool::JobQueue::getContentionCount() const
+{
+  return m_contentionCount.load(std::memory_order_relaxed);
+}
+#endif
+
+// ThreadPool::Statistics::Histogram
+
+inline uint64_t ThreadPool::Statistics::Histogram::getCount() const
+{
+  uint64_t count = 0;
+  for (int i = 0; i < bucketCount; i++)
+    count += counts[i];
+  return count;
+}
+
+inline uint64_t ThreadPool::Statistics::Histogram::getPercentile(double fraction) const
+{
+  uint64_t count = getCount();
+  uint64_t target = (uint64_t)(fraction * count);
+  uint64_t sum = 0;
+  for (int i = 0; i < bucketCount; i++)
+  {
+    sum += counts[i];
+    if (count > 0 && sum >= target)
+      return (uint64_t)2 << i;
+  }
+  return 0;
+}
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+
+// ThreadPool::Counters
+
+inline void ThreadPool::Counters::add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+  // a single writer doesn't need the locked instruction
+  if (m_shared)
+    counter.fetch_add(value, std::memory_order_relaxed);
+  else
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void ThreadPool::Counters::addDuration(std::atomic<uint64_t>* histogram, uint64_t ticks)
+{
+  int bucket = ticks > 1 ? Platform::Cpu::mostSignificantSetBit(ticks) : 0;
+  add(histogram[bucket < Statistics::Histogram::bucketCount ? bucket : Statistics::Histogram::bucketCount - 1], 1);
+}
+
+inline void ThreadPool::Counters::collect(Statistics::ThreadStatistics& thread, Statistics& statistics,
+  double nanosecondsPerTick) const
+{
+  thread.jobCount = m_jobCount.load(std::memory_order_relaxed);
+  thread.stealCount = m_stealCount.load(std::memory_order_relaxed);
+  thread.busyTime = (uint64_t)(m_busyTicks.load(std::memory_order_relaxed) * nanosecondsPerTick);
+  thread.idleTime = (uint64_t)(m_idleTicks.load(std::memory_order_relaxed) * nanosecondsPerTick);
+
+  statistics.jobCount += thread.jobCount;
+  statistics.stealCount += thread.stealCount;
+  for (int i = 0; i < Statistics::Histogram::bucketCount; i++)
+  {
+    statistics.queueDelay.counts[i] += m_queueDelay[i].load(std::memory_order_relaxed);
+    statistics.runTime.counts[i] += m_runTime[i].load(std::memory_order_relaxed);
+  }
+}
+
+#endif
+
+// ThreadPool::Thread
+
+inline void ThreadPool::Thread::execute()
+{
+  currentThread() = this;
+
+  // the queue is allocated by the thread itself after binding, so its memory is local to the thread node
+  if (!m_cpus.empty())
+    Platform::Cpu::setCurrentThreadAffinity(m_cpus);
+  m_jobs.reserve();
+  m_batch.resize(m_threadPool->m_batchSize);
+  m_context.m_threadIndex = m_index;
+  m_context.m_node = m_node;
+  m_spinCount = m_threadPool->m_spinCount;
+  Trace::setThreadName("ThreadPool thread " + std::to_string(m_index));
+
+  for (;;)
+  {
+    // the threads reserved for high priority jobs don't run the timers
+    if (!m_highPriority)
+      m_threadPool->fireTimers();
+
+    Job job;
+    if (m_threadPool->takeJob(job, this))
+    {
+      m_threadPool->runJob(job);
+      continue;
+    }
+
+#ifdef HELPER_THREADPOOL_STATISTICS
+    uint64_t idleTicks = Platform::Cpu::readTimestampCounter();
+#endif
+    if (!spin())
+    {
+      if (!sleep())
+        break;
+    }
+#ifdef HELPER_THREADPOOL_STATISTICS
+    m_counters.add(m_counters.m_idleTicks, Platform::Cpu::readTimestampCounter() - idleTicks);
+#endif
+  }
+
+  currentThread() = nullptr;
+}
+
+inline bool ThreadPool::Thread::sleep()
+{
+  // the threads reserved for high priority jobs wait for them only
+  std::atomic<int>& queuedJobs = m_highPriority ? m_threadPool->m_queuedHighPriorityJobs : m_threadPool->m_queuedJobs;
+  std::atomic<int>& sleepingThreads = m_highPriority ? m_threadPool->m_sleepingHighPriorityThreads : m_threadPool->m_sleepingThreads;
+  std::condition_variable& condition = m_highPriority ? m_threadPool->m_highPriorityCondition : m_threadPool->m_condition;
+
+  ThreadPool& pool = *m_threadPool;
+  std::unique_lock<std::mutex> lock(pool.m_mutex);
+  sleepingThreads.fetch_add(1);
+  bool timerWaiter = false;
+  bool exiting = false;
+  for (; !pool.m_destroying && queuedJobs.load() == 0;)
+  {
+    if (m_highPriority || pool.m_timerCount.load() == 0 || (pool.m_timerWaiter && !timerWaiter))
+    {
+      // the threads of an elastic pool above the minimum exit after the idle timeout
+      if (m_highPriority || pool.m_idleTimeout.count() == 0 || pool.m_activeThreads.load() <= pool.m_minThreadCount)
+      {
+        condition.wait(lock);
+        continue;
+      }
+
+      if (condition.wait_for(lock, pool.m_idleTimeout) == std::cv_status::timeout && !pool.m_destroying &&
+        queuedJobs.load() == 0 && pool.m_activeThreads.load() > pool.m_minThreadCount)
+      {
+        exiting = true;
+        break;
+      }
+      continue;
+    }
+
+    // a single sleeping thread wakes up for the next timer, the thread adding an earlier one notifies it
+    pool.m_timerWaiter = timerWaiter = true;
+    uint64_t nextTick = pool.m_nextTimerTick.load();
+    if (pool.currentTimerTick() >= nextTick)
+      break;
+    if (nextTick == UINT64_MAX)
+      condition.wait(lock);
+    else
+      condition.wait_until(lock, pool.m_timerStart + pool.m_timerResolution * (int64_t)nextTick);
+  }
+  if (timerWaiter)
+    pool.m_timerWaiter = false;
+  sleepingThreads.fetch_sub(1);
+
+  if (exiting)
+  {
+    m_active = false;
+    pool.m_activeThreads.fetch_sub(1);
+    return false;
+  }
+
+  // remaining jobs are finished before the pool is destroyed
+  return !m_threadPool->m_destroying || queuedJobs.load() != 0;
+}
+
+inline bool ThreadPool::Thread::spin()
+{
+  // a polling thread is not counted as sleeping, so the jobs added meanwhile are taken without the notification
+  // and wake up cost
+  ThreadPool& pool = *m_threadPool;
+  int minSpinCount = pool.m_spinCount / 16;
+  for (int i = 0;; i++)
+  {
+    IdlePolicy policy = pool.m_idlePolicy.load(std::memory_order_relaxed);
+    if (policy == IdlePolicy::Sleep || pool.m_destroying.load(std::memory_order_relaxed))
+      return false;
+
+    if ((m_highPriority ? pool.m_queuedHighPriorityJobs : pool.m_queuedJobs).load(std::memory_order_relaxed) > 0)
+    {
+      // the jobs come soon after the thread gets idle, polling longer is worth it
+      m_spinCount = std::min(std::max(m_spinCount * 2, minSpinCount), pool.m_spinCount);
+      return true;
+    }
+
+    if (!m_highPriority && (i & 63) == 63 && pool.hasDueTimers())
+      return true;
+
+    if (policy == IdlePolicy::Spin && i >= m_spinCount)
+    {
+      m_spinCount = std::max(m_spinCount / 2, minSpinCount);
+      return false;
+    }
 
-    m_threadPool->m_condition.notify_one();
-    m_condition.wait(lock);
+    Platform::Cpu::pause();
+    // lets other threads run on the cpu if it is oversubscribed
+    if ((i & 1023) == 1023)
+      std::this_thread::yield();
   }
 }
 
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Platform/Cpu/intrinsics.h"
+
+namespace Helper
+{
+
+// hierarchical timing wheel: level l has slotCount slots of slotCount^l ticks each, a timer is put to the level of the
+// highest bits its expiry differs from the current tick in, so adding and removing a timer is O(1), and the timers of
+// a higher level slot are moved to the lower levels when the current tick reaches the slot, the timers farther than
+// the range of the wheel wait in its last slots and are placed again on each pass
+class TimerWheel
+{
+public:
+  typedef std::function<void()> Function;
+  // 0 is not a valid id
+  typedef uint64_t TimerId;
+
+  constexpr static int slotBits = 6;
+  constexpr static int slotCount = 1 << slotBits;
+  constexpr static int levelCount = 6;
+
+  inline TimerWheel();
+
+  // the timer expires at tick expiry and then every period ticks if period > 0, the expired timers are returned
+  // by advance()
+  inline TimerId add(uint64_t expiry, uint64_t period, const std::shared_ptr<const Function>& function);
+  // returns false if the timer is expired or removed already
+  inline bool remove(TimerId id);
+
+  // makes all the ticks up to now passed, fire(function) is called for each expired timer in the order of expiry,
+  // a periodic timer is added again for its next expiry after now
+  template<typename Fire>
+  inline void advance(uint64_t now, const Fire& fire);
+
+  // the next tick advance() has something to do at, a timer doesn't expire earlier, UINT64_MAX if there are no timers
+  inline uint64_t getNextTick() const;
+  // the first tick not passed yet
+  inline uint64_t getCurrentTick() const;
+  inline size_t getCount() const;
+
+private:
+  struct Timer
+  {
+    std::shared_ptr<const Function> m_function;
+    uint64_t m_expiry = 0;
+    uint64_t m_period = 0;
+    int m_previous = -1;
+    int m_next = -1;
+    int m_slot = -1; // level * slotCount + slot, -1 for a free timer
+    uint32_t m_generation = 0;
+  };
+
+  inline void insert(int index);
+  inline void unlink(int index);
+
+  std::vector<Timer> m_timers;
+  std::vector<int> m_freeTimers;
+  int m_slots[levelCount * slotCount];
+  // nonempty slots of the levels
+  uint64_t m_occupied[levelCount] = {};
+  uint64_t m_now = 0;
+  size_t m_count = 0;
+};
+
+// implementation
+
+inline TimerWheel::TimerWheel()
+{
+  static_assert(slotCount == 64, "a level is tracked by a 64 bit mask");
+  static_assert(slotBits * levelCount < 64, "the range of the wheel should fit the tick");
+
+  for (int i = 0; i < levelCount * slotCount; i++)
+    m_slots[i] = -1;
+}
+
+inline TimerWheel::TimerId TimerWheel::add(uint64_t expiry, uint64_t period, const std::shared_ptr<const Function>& function)
+{
+  int index;
+  if (!m_freeTimers.empty())
+  {
+    index = m_freeTimers.back();
+    m_freeTimers.pop_back();
+  }
+  else
+  {
+    index = (int)m_timers.size();
+    m_timers.emplace_back();
+  }
+
+  Timer& timer = m_timers[index];
+  timer.m_function = function;
+  timer.m_expiry = expiry;
+  timer.m_period = period;
+  insert(index);
+  m_count++;
+
+  return ((TimerId)timer.m_generation << 32) | (TimerId)(index + 1);
+}
+
+inline bool TimerWheel::remove(TimerId id)
+{
+  int index = (int)(uint32_t)id - 1;
+  if (index < 0 || index >= (int)m_timers.size())
+    return false;
+
+  Timer& timer = m_timers[index];
+  if (timer.m_slot < 0 || timer.m_generation != (uint32_t)(id >> 32))
+    return false;
+
+  unlink(index);
+  timer.m_function.reset();
+  timer.m_generation++;
+  m_freeTimers.push_back(index);
+  m_count--;
+  return true;
+}
+
+template<typename Fire>
+inline void TimerWheel::advance(uint64_t now, const Fire& fire)
+{
+  for (;;)
+  {
+    // the ticks without anything to do are skipped at once
+    uint64_t tick = getNextTick();
+    if (tick > now)
+    {
+      if (now + 1 > m_now)
+        m_now = now + 1;
+      return;
+    }
+
+    m_now = tick;
+
+    // the slots starting at this tick are spread to the lower levels, from the highest one
+    for (int level = levelCount - 1; level > 0; level--)
+    {
+      if (m_now & (((uint64_t)1 << (slotBits * level)) - 1))
+        continue;
+
+      int slot = level * slotCount + (int)((m_now >> (slotBits * level)) & (slotCount - 1));
+      int index = m_slots[slot];
+      m_slots[slot] = -1;
+      m_occupied[level] &= ~((uint64_t)1 << (slot & (slotCount - 1)));
+      for (; index >= 0;)
+      {
+        int next = m_timers[index].m_next;
+        insert(index);
+        index = next;
+      }
+    }
+
+    int slot = (int)(m_now & (slotCount - 1));
+    int index = m_slots[slot];
+    m_slots[slot] = -1;
+    m_occupied[0] &= ~((uint64_t)1 << slot);
+    m_now++;
+
+    for (; index >= 0;)
+    {
+      Timer& timer = m_timers[index];
+      int next = timer.m_next;
+      // a timer beyond the range has reached the end of the previous range
+      if (timer.m_expiry >= m_now)
+      {
+        insert(index);
+        index = next;
+        continue;
+      }
+
+      fire(timer.m_function);
+
+      if (timer.m_period > 0)
+      {
+        // the periods missed by a late advance() are skipped
+        timer.m_expiry += timer.m_period;
+        if (timer.m_expiry <= now)
+          timer.m_expiry += (now - timer.m_expiry) / timer.m_period * timer.m_period + timer.m_period;
+        insert(index);
+      }
+      else
+      {
+        timer.m_slot = -1;
+        timer.m_function.reset();
+        timer.m_generation++;
+        m_freeTimers.push_back(index);
+        m_count--;
+      }
+      index = next;
+    }
+  }
+}
+
+inline uint64_t TimerWheel::getNextTick() const
+{
+  uint64_t result = UINT64_MAX;
+  for (int level = 0; level < levelCount; level++)
+  {
+    int shift = slotBits * level;
+    int current = (int)((m_now >> shift) & (slotCount - 1));
+    // the current slot of a higher level is reached only at its start
+    bool started = level > 0 && (m_now & (((uint64_t)1 << shift) - 1)) != 0;
+    uint64_t mask = m_occupied[level] & (~(uint64_t)0 << current);
+    if (started)
+      mask &= ~((uint64_t)1 << current);
+    if (!mask)
+      continue;
+
+    int slot = Platform::Cpu::leastSignificantSetBit(mask);
+    uint64_t tick = (m_now & ~(((uint64_t)1 << (shift + slotBits)) - 1)) | ((uint64_t)slot << shift);
+    if (tick < result)
+      result = tick;
+  }
+  return result;
+}
+
+inline uint64_t TimerWheel::getCurrentTick() const
+{
+  return m_now;
+}
+
+inline size_t TimerWheel::getCount() const
+{
+  return m_count;
+}
+
+inline void TimerWheel::insert(int index)
+{
+  Timer& timer = m_timers[index];
+
+  // the expired timers go to the current slot, the ones beyond the range to the last slot of the range
+  uint64_t expiry = timer.m_expiry < m_now ? m_now : timer.m_expiry;
+  uint64_t rangeEnd = m_now | (((uint64_t)1 << (slotBits * levelCount)) - 1);
+  if (expiry > rangeEnd)
+    expiry = rangeEnd;
+
+  uint64_t difference = expiry ^ m_now;
+  int level = difference ? Platform::Cpu::mostSignificantSetBit(difference) / slotBits : 0;
+  int slot = (int)((expiry >> (slotBits * level)) & (slotCount - 1));
+
+  timer.m_slot = level * slotCount + slot;
+  timer.m_previous = -1;
+  timer.m_next = m_slots[timer.m_slot];
+  if (timer.m_next >= 0)
+    m_timers[timer.m_next].m_previous = index;
+  m_slots[timer.m_slot] = index;
+  m_occupied[level] |= (uint64_t)1 << slot;
+}
+
+inline void TimerWheel::unlink(int index)
+{
+  Timer& timer = m_timers[index];
+  if (timer.m_previous >= 0)
+    m_timers[timer.m_previous].m_next = timer.m_next;
+  else
+    m_slots[timer.m_slot] = timer.m_next;
+  if (timer.m_next >= 0)
+    m_timers[timer.m_next].m_previous = timer.m_previous;
+
+  if (m_slots[timer.m_slot] < 0)
+    m_occupied[timer.m_slot / slotCount] &= ~((uint64_t)1 << (timer.m_slot % slotCount));
+  timer.m_slot = -1;
+}
+
+}
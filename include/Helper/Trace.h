@@ -0,0 +1,299 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Platform/Cpu/intrinsics.h"
+
+#define HELPER_TRACE_CONCATENATE_(a, b) a##b
+#define HELPER_TRACE_CONCATENATE(a, b) HELPER_TRACE_CONCATENATE_(a, b)
+// marks the rest of the enclosing block, name should be a string literal
+#define HELPER_TRACE_SCOPE(name) Helper::Trace::Scope HELPER_TRACE_CONCATENATE(helperTraceScope, __LINE__)(name)
+
+namespace Helper
+{
+
+// timeline of named scopes, each thread records its scopes to its own ring buffer without locks, the oldest events
+// are overwritten, the timeline is written in the Chrome trace event format viewed by chrome://tracing or Perfetto,
+// a disabled trace costs a relaxed load per scope
+class Trace
+{
+public:
+  // events kept per thread
+  constexpr static size_t eventCapacity = 1 << 15;
+
+  class Scope
+  {
+  public:
+    // name is stored by pointer, so it should live until the trace is written
+    inline explicit Scope(const char* name);
+    inline ~Scope();
+
+  private:
+    Scope(const Scope& other) = delete;
+    Scope& operator=(const Scope& other) = delete;
+
+    const char* m_name;
+    uint64_t m_begin;
+  };
+
+  static inline bool isEnabled();
+  static inline void setEnabled(bool enabled);
+
+  // name of the current thread in the timeline, a thread started later with the same name continues the track of
+  // the exited one, so the restarted threads of a pool don't add tracks
+  static inline void setThreadName(const std::string& name);
+
+  // times by Platform::Cpu::readTimestampCounter()
+  static inline void record(const char* name, uint64_t begin, uint64_t end);
+  // drops the recorded events, the threads should not record meanwhile
+  static inline void clear();
+
+  // the threads should not record meanwhile, e.g. the trace is disabled and the pool jobs are finished
+  static inline void write(std::ostream& stream);
+  static inline bool write(const char* fileName);
+
+private:
+  struct Event
+  {
+    const char* m_name;
+    uint64_t m_begin;
+    uint64_t m_end;
+  };
+
+  struct ThreadBuffer
+  {
+    std::unique_ptr<Event[]> m_events;
+    // number of events ever recorded, written by the owner thread only
+    std::atomic<uint64_t> m_count{0};
+    // empty for the threads without a name
+    std::string m_name;
+    int m_id;
+    // the owner thread has exited, the buffer is given to the next thread of the same name
+    bool m_free = false;
+  };
+
+  // gives the buffer of the thread back when the thread exits
+  struct BufferOwner
+  {
+    ThreadBuffer* m_buffer = nullptr;
+
+    inline ~BufferOwner();
+  };
+
+  struct State
+  {
+    std::atomic<bool> m_enabled{false};
+    std::mutex m_mutex;
+    // the buffers outlive their threads, so the jobs of a destroyed pool are written too, guarded by m_mutex
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    uint64_t m_startTicks = 0;
+    std::chrono::steady_clock::time_point m_startTime;
+  };
+
+  static inline State& state();
+  static inline BufferOwner& currentBufferOwner();
+  static inline std::string& currentThreadName();
+  static inline ThreadBuffer* createBuffer();
+  static inline void writeString(std::ostream& stream, const char* s);
+};
+
+// implementation
+
+inline Trace::Scope::Scope(const char* name) : m_name(Trace::isEnabled() ? name : nullptr),
+  m_begin(m_name ? Platform::Cpu::readTimestampCounter() : 0)
+{
+}
+
+inline Trace::Scope::~Scope()
+{
+  if (m_name)
+    Trace::record(m_name, m_begin, Platform::Cpu::readTimestampCounter());
+}
+
+inline bool Trace::isEnabled()
+{
+  return state().m_enabled.load(std::memory_order_relaxed);
+}
+
+inline void Trace::setEnabled(bool enabled)
+{
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  if (enabled && s.m_startTicks == 0)
+  {
+    s.m_startTicks = Platform::Cpu::readTimestampCounter();
+    s.m_startTime = std::chrono::steady_clock::now();
+  }
+  s.m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline void Trace::setThreadName(const std::string& name)
+{
+  currentThreadName() = name;
+
+  ThreadBuffer* buffer = currentBufferOwner().m_buffer;
+  if (buffer)
+  {
+    std::lock_guard<std::mutex> lock(state().m_mutex);
+    buffer->m_name = name;
+  }
+}
+
+inline void Trace::record(const char* name, uint64_t begin, uint64_t end)
+{
+  ThreadBuffer* buffer = currentBufferOwner().m_buffer;
+  if (!buffer)
+    buffer = createBuffer();
+
+  uint64_t count = buffer->m_count.load(std::memory_order_relaxed);
+  Event& event = buffer->m_events[count & (eventCapacity - 1)];
+  event.m_name = name;
+  event.m_begin = begin;
+  event.m_end = end;
+  buffer->m_count.store(count + 1, std::memory_order_release);
+}
+
+inline void Trace::clear()
+{
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  for (const std::unique_ptr<ThreadBuffer>& buffer : s.m_buffers)
+    buffer->m_count.store(0, std::memory_order_relaxed);
+}
+
+inline void Trace::write(std::ostream& stream)
+{
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+
+  // the tick length is measured by the time passed since the trace was enabled first
+  uint64_t ticks = Platform::Cpu::readTimestampCounter() - s.m_startTicks;
+  double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - s.m_startTime).count();
+  double microsecondsPerTick = ticks > 0 ? nanoseconds / ticks / 1000 : 0.001;
+
+  stream << "{\"traceEvents\":[";
+  bool first = true;
+  char number[64];
+  for (const std::unique_ptr<ThreadBuffer>& buffer : s.m_buffers)
+  {
+    stream << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->m_id
+      << ",\"args\":{\"name\":";
+    writeString(stream, buffer->m_name.empty() ? ("thread " + std::to_string(buffer->m_id)).c_str() : buffer->m_name.c_str());
+    stream << "}}";
+    first = false;
+
+    uint64_t count = buffer->m_count.load(std::memory_order_acquire);
+    for (uint64_t i = count > eventCapacity ? count - eventCapacity : 0; i < count; i++)
+    {
+      const Event& event = buffer->m_events[i & (eventCapacity - 1)];
+      // the events recorded before the first enabling are placed to the start
+      uint64_t begin = event.m_begin > s.m_startTicks ? event.m_begin - s.m_startTicks : 0;
+      uint64_t duration = event.m_end > event.m_begin ? event.m_end - event.m_begin : 0;
+      stream << ",\n{\"name\":";
+      writeString(stream, event.m_name);
+      snprintf(number, sizeof(number), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", begin * microsecondsPerTick,
+        duration * microsecondsPerTick);
+      stream << number << ",\"pid\":1,\"tid\":" << buffer->m_id << "}";
+    }
+  }
+  stream << "\n]}\n";
+}
+
+inline bool Trace::write(const char* fileName)
+{
+  std::ofstream stream(fileName, std::ios::out | std::ios::trunc);
+  if (!stream)
+    return false;
+
+  write(stream);
+  stream.close();
+  return !stream.fail();
+}
+
+inline Trace::State& Trace::state()
+{
+  static State s;
+  return s;
+}
+
+inline Trace::BufferOwner& Trace::currentBufferOwner()
+{
+  static thread_local BufferOwner owner;
+  return owner;
+}
+
+inline std::string& Trace::currentThreadName()
+{
+  static thread_local std::string name;
+  return name;
+}
+
+inline Trace::ThreadBuffer* Trace::createBuffer()
+{
+  static_assert((eventCapacity & (eventCapacity - 1)) == 0, "eventCapacity should be power of 2");
+
+  State& s = state();
+  BufferOwner& owner = currentBufferOwner();
+  const std::string& name = currentThreadName();
+  {
+    std::lock_guard<std::mutex> lock(s.m_mutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : s.m_buffers)
+    {
+      if (buffer->m_free && buffer->m_name == name)
+      {
+        buffer->m_free = false;
+        owner.m_buffer = buffer.get();
+        return owner.m_buffer;
+      }
+    }
+  }
+
+  std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+  buffer->m_events.reset(new Event[eventCapacity]);
+  buffer->m_name = name;
+
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  buffer->m_id = (int)s.m_buffers.size() + 1;
+  s.m_buffers.push_back(std::move(buffer));
+  owner.m_buffer = s.m_buffers.back().get();
+  return owner.m_buffer;
+}
+
+inline Trace::BufferOwner::~BufferOwner()
+{
+  if (!m_buffer)
+    return;
+
+  std::lock_guard<std::mutex> lock(state().m_mutex);
+  m_buffer->m_free = true;
+}
+
+inline void Trace::writeString(std::ostream& stream, const char* s)
+{
+  stream << '"';
+  for (; *s; s++)
+  {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      stream << '\\' << (char)c;
+    else if (c < 0x20)
+    {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      stream << escaped;
+    }
+    else
+      stream << (char)c;
+  }
+  stream << '"';
+}
+
+}